@@ -9,12 +9,88 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
 #include "esp_log.h"
 
 #include "ds1302.h"
 
 #define TAG "DS1302"
 
+//! Clock register value masks and ranges in decimal
+static const uint8_t clockMask[7] = { 0x7F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+static const uint8_t clockMin[7] = { 0, 0, 0, 1, 1, 1, 0 };
+static const uint8_t clockMax[7] = { 59, 59, 23, 31, 12, 7, 99 };
+
+/*!
+ * \brief Check a raw clock register value
+ * \param reg
+ *      Clock register 0..6
+ * \param value
+ *      Register value
+ * \return
+ *      true:  Valid BCD within range
+ *      false: Invalid
+ */
+static bool DS1302_isValidClock(uint8_t reg, uint8_t value)
+{
+    uint8_t dec;
+
+    value &= clockMask[reg];
+    if ((value & 0x0F) > 9) {
+        return false;
+    }
+    dec = bcdToDec(value);
+
+    return (dec >= clockMin[reg]) && (dec <= clockMax[reg]);
+}
+
+/*!
+ * \brief Clock out a byte with microsecond bit timing
+ * \param value
+ *      Address/command or data byte
+ * \param turnaround
+ *      true: Leave CLK high after the last bit and release IO for reading
+ */
+static void DS1302_clockOutFast(DS1302_Dev *dev, uint8_t value, bool turnaround)
+{
+    for (uint8_t i = 0; i < 8; i++) {
+        gpio_set_level(dev->ioPin, (value >> i) & 0x01);
+        esp_rom_delay_us(1);
+        gpio_set_level(dev->clkPin, 1);
+        esp_rom_delay_us(1);
+
+        if (turnaround && (i == 7)) {
+            gpio_set_direction(dev->ioPin, GPIO_MODE_INPUT);
+        } else {
+            gpio_set_level(dev->clkPin, 0);
+        }
+    }
+}
+
+/*!
+ * \brief Clock in a byte with microsecond bit timing
+ * \return
+ *      Data byte
+ */
+static uint8_t DS1302_clockInFast(DS1302_Dev *dev)
+{
+    uint8_t value = 0;
+
+    for (uint8_t i = 0; i < 8; i++) {
+        gpio_set_level(dev->clkPin, 1);
+        gpio_set_level(dev->clkPin, 0);
+        esp_rom_delay_us(1);
+
+        value >>= 1;
+        if (gpio_get_level(dev->ioPin)) {
+            value |= 0x80;
+        }
+    }
+
+    return value;
+}
+
 /*!
  * \brief Initialize DS1302.
  * \param clkPin
@@ -25,7 +101,7 @@
  *      Chip select pin. (In previous versions RST pin which is the same)
  * \return
  *      true:  RTC running
- *      false: RTC halted or not detected
+ *      false: RTC halted or not detected (see dev->link)
  */
 bool DS1302_begin(DS1302_Dev *dev, uint8_t clkPin, uint8_t ioPin, uint8_t cePin)
 {
@@ -39,6 +115,7 @@ bool DS1302_begin(DS1302_Dev *dev, uint8_t clkPin, uint8_t ioPin, uint8_t cePin)
     dev->clkPin = clkPin;
     dev->ioPin = ioPin;
     dev->cePin = cePin;
+    dev->transfers = 0;
 
     // Initialize pins
     gpio_set_level(dev->clkPin, 0);
@@ -49,6 +126,14 @@ bool DS1302_begin(DS1302_Dev *dev, uint8_t clkPin, uint8_t ioPin, uint8_t cePin)
     gpio_set_direction(dev->ioPin, GPIO_MODE_OUTPUT);
     gpio_set_direction(dev->cePin, GPIO_MODE_OUTPUT);
 
+    // A floating IO line reads as stuck high
+    gpio_set_pull_mode(dev->ioPin, GPIO_PULLUP_ONLY);
+
+    // Check the bus before touching the clock
+    if (DS1302_linkProbe(dev) != DS1302_LINK_OK) {
+        return false;
+    }
+
     // Enable RTC clock
     DS1302_halt(dev, false);
 
@@ -60,6 +145,99 @@ bool DS1302_begin(DS1302_Dev *dev, uint8_t clkPin, uint8_t ioPin, uint8_t cePin)
     }
 }
 
+/*!
+ * \brief Check the bus with one clock burst read
+ * \return
+ *      Link state, also stored in dev->link
+ * \note
+ *      The write protect register is either 0x00 or 0x80 and the day of
+ *      the month is never 0x00. When all registers read 0x00 the line may
+ *      be stuck low or the chip zeroed, then the RAM canary decides.
+ */
+DS1302_Link DS1302_linkProbe(DS1302_Dev *dev)
+{
+    uint8_t buf[8];
+    uint8_t any = 0;
+
+    DS1302_transferBegin(dev);
+    DS1302_writeAddrCmd(dev, DS1302_CMD_READ_CLOCK_BURST);
+    for (uint8_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = DS1302_readByte(dev);
+        any |= buf[i];
+    }
+    DS1302_transferEnd(dev);
+
+    if (buf[DS1302_REG_WP] == 0xFF) {
+        dev->link = DS1302_LINK_STUCK_HIGH;
+    } else if (buf[DS1302_REG_WP] & ~(1 << DS1302_BIT_WP)) {
+        dev->link = DS1302_LINK_BIT_ERROR;
+    } else if (any == 0x00) {
+        return DS1302_linkCheck(dev);
+    } else {
+        dev->link = DS1302_LINK_OK;
+    }
+    DS1302_DEBUG(TAG, "DS1302_linkProbe wp=%02x link=%d", buf[DS1302_REG_WP], dev->link);
+
+    return dev->link;
+}
+
+/*!
+ * \brief Check the bus with a RAM canary
+ * \return
+ *      Link state, also stored in dev->link
+ * \note
+ *      Writes two patterns to the last RAM byte and restores it.
+ *      A stuck high line or a corrupted write protect register is
+ *      detected by the first register read.
+ *      DS1302_begin() only runs it when DS1302_linkProbe() is inconclusive.
+ */
+DS1302_Link DS1302_linkCheck(DS1302_Dev *dev)
+{
+    const uint8_t addr = NUM_DS1302_RAM_REGS - 1;
+    uint8_t wp;
+    uint8_t orig;
+    uint8_t read1;
+    uint8_t read2;
+
+    // The write protect register is either 0x00 or 0x80
+    wp = DS1302_readClockRegister(dev, DS1302_REG_WP);
+    if (wp == 0xFF) {
+        dev->link = DS1302_LINK_STUCK_HIGH;
+        return dev->link;
+    }
+    if (wp & ~(1 << DS1302_BIT_WP)) {
+        dev->link = DS1302_LINK_BIT_ERROR;
+        return dev->link;
+    }
+    if (wp) {
+        DS1302_writeClockRegister(dev, DS1302_REG_WP, 0);
+    }
+
+    orig = DS1302_readByteRAM(dev, addr);
+    DS1302_writeByteRAM(dev, addr, 0xA5);
+    read1 = DS1302_readByteRAM(dev, addr);
+    DS1302_writeByteRAM(dev, addr, 0x5A);
+    read2 = DS1302_readByteRAM(dev, addr);
+    DS1302_writeByteRAM(dev, addr, orig);
+
+    if (wp) {
+        DS1302_writeClockRegister(dev, DS1302_REG_WP, wp);
+    }
+
+    if ((read1 == 0xA5) && (read2 == 0x5A)) {
+        dev->link = DS1302_LINK_OK;
+    } else if ((read1 == 0x00) && (read2 == 0x00)) {
+        dev->link = DS1302_LINK_STUCK_LOW;
+    } else if ((read1 == 0xFF) && (read2 == 0xFF)) {
+        dev->link = DS1302_LINK_STUCK_HIGH;
+    } else {
+        dev->link = DS1302_LINK_BIT_ERROR;
+    }
+    DS1302_DEBUG(TAG, "DS1302_linkCheck read=%02x,%02x link=%d", read1, read2, dev->link);
+
+    return dev->link;
+}
+
 /*!
  * \brief Set write protect flag
  * \param enable
@@ -98,7 +276,7 @@ void DS1302_halt(DS1302_Dev *dev, bool halt)
     uint8_t regNew;
     
     regOld = DS1302_readClockRegister(dev, DS1302_REG_SECONDS);
-    ESP_LOGD(TAG, "DS1302_halt regOld=%02x", regOld);
+    DS1302_DEBUG(TAG, "DS1302_halt regOld=%02x", regOld);
     if (halt) {
         regNew = (uint8_t)(regOld | (1 << DS1302_BIT_CH));
     } else {
@@ -119,8 +297,8 @@ void DS1302_halt(DS1302_Dev *dev, bool halt)
 bool DS1302_isHalted(DS1302_Dev *dev)
 {
     uint8_t val = DS1302_readClockRegister(dev, DS1302_REG_SECONDS);
-ESP_LOGD(TAG,"DS1302_REG_SECONDS=%02x",val);
-    if (DS1302_readClockRegister(dev, DS1302_REG_SECONDS) & (1 << DS1302_BIT_CH)) {
+    DS1302_DEBUG(TAG, "DS1302_REG_SECONDS=%02x", val);
+    if (val & (1 << DS1302_BIT_CH)) {
         return true;
     } else {
         return false;
@@ -154,46 +332,183 @@ void DS1302_setDateTime(DS1302_Dev *dev, DS1302_DateTime *dateTime)
 }
 
 /*!
- * \brief Get RTC date and time
+ * \brief Store a decoded clock register into the date time structure
+ */
+static void DS1302_decodeClock(uint8_t reg, uint8_t value, DS1302_DateTime *dateTime)
+{
+    switch (reg) {
+    case DS1302_REG_SECONDS:
+        dateTime->second = bcdToDec(value & 0x7F); // Without CH bit from seconds register
+        break;
+    case DS1302_REG_MINUTES:
+        dateTime->minute = bcdToDec(value);
+        break;
+    case DS1302_REG_HOURS:
+        dateTime->hour = bcdToDec(value);
+        break;
+    case DS1302_REG_DAY_MONTH:
+        dateTime->dayMonth = bcdToDec(value);
+        break;
+    case DS1302_REG_MONTH:
+        dateTime->month = bcdToDec(value);
+        break;
+    case DS1302_REG_DAY_WEEK:
+        dateTime->dayWeek = bcdToDec(value);
+        break;
+    case DS1302_REG_YEAR:
+        dateTime->year = 2000 + bcdToDec(value);
+        break;
+    }
+}
+
+/*!
+ * \brief Encode a field of the date time structure as clock register (always 24H)
+ */
+static uint8_t DS1302_encodeClock(uint8_t reg, const DS1302_DateTime *dateTime)
+{
+    switch (reg) {
+    case DS1302_REG_SECONDS:
+        return decToBcd((uint8_t)(dateTime->second & 0x7F));
+    case DS1302_REG_MINUTES:
+        return decToBcd(dateTime->minute);
+    case DS1302_REG_HOURS:
+        return decToBcd((uint8_t)(dateTime->hour & 0x3F));
+    case DS1302_REG_DAY_MONTH:
+        return decToBcd((uint8_t)(dateTime->dayMonth & 0x3F));
+    case DS1302_REG_MONTH:
+        return decToBcd((uint8_t)(dateTime->month & 0x1F));
+    case DS1302_REG_DAY_WEEK:
+        return decToBcd((uint8_t)(dateTime->dayWeek & 0x07));
+    default:
+        return decToBcd((uint8_t)((dateTime->year - 2000) & 0xFF));
+    }
+}
+
+/*!
+ * \brief Get selected RTC date and time fields
+ * \param fields
+ *      DS1302_FIELD_* mask
  * \param dateTime
- *      Date and time structure
+ *      Date and time structure, only the selected fields are changed
+ * \return
+ *      true:  Valid fields
+ *      false: Invalid field, the selected fields are zeroed
+ * \note
+ *      One burst read up to the highest selected register, so all fields come
+ *      from the same snapshot. The burst is aborted at the first invalid field.
+ *      A valid read sets dev->link back to DS1302_LINK_OK.
  */
-bool DS1302_getDateTime(DS1302_Dev *dev, DS1302_DateTime *dateTime)
+bool DS1302_getFields(DS1302_Dev *dev, uint8_t fields, DS1302_DateTime *dateTime)
 {
     uint8_t buf[7];
+    uint8_t len = 0;
+    uint8_t i;
+    bool zero = true;
 
-    // Read clock date and time registers
+    fields &= DS1302_FIELD_ALL;
+    while (fields >> len) {
+        len++;
+    }
+
+    // Read clock registers, stop at the first invalid selected one
     DS1302_transferBegin(dev);
     DS1302_writeAddrCmd(dev, DS1302_CMD_READ_CLOCK_BURST);
-    DS1302_readBuffer(dev, &buf, sizeof(buf));
-    for(int i=0;i<7;i++) ESP_LOGD(TAG, "buf[%d]=0x%x",i,buf[i]);
+    for (i = 0; i < len; i++) {
+        buf[i] = DS1302_readByte(dev);
+        if ((fields & (1 << i)) && !DS1302_isValidClock(i, buf[i])) {
+            break;
+        }
+    }
     DS1302_transferEnd(dev);
 
+    if (i < len) {
+        DS1302_WARN(TAG, "clock register %d invalid 0x%02x", i, buf[i]);
+        if (buf[i] == 0xFF) {
+            dev->link = DS1302_LINK_STUCK_HIGH;
+        } else if (i >= DS1302_REG_DAY_MONTH) {
+            uint8_t j = 0;
+            while ((j <= i) && (buf[j] == 0x00)) {
+                j++;
+            }
+            if (j > i) {
+                dev->link = DS1302_LINK_STUCK_LOW;
+            }
+        }
+        if (fields & DS1302_FIELD_SECOND) dateTime->second = 0;
+        if (fields & DS1302_FIELD_MINUTE) dateTime->minute = 0;
+        if (fields & DS1302_FIELD_HOUR) dateTime->hour = 0;
+        if (fields & DS1302_FIELD_DAY_MONTH) dateTime->dayMonth = 0;
+        if (fields & DS1302_FIELD_MONTH) dateTime->month = 0;
+        if (fields & DS1302_FIELD_DAY_WEEK) dateTime->dayWeek = 0;
+        if (fields & DS1302_FIELD_YEAR) dateTime->year = 0;
+        return false;
+    }
+
     // Convert BCD buffer to Decimal
-    dateTime->second = bcdToDec(buf[0] & 0x7f); // Without CH bit from seconds register
-    dateTime->minute = bcdToDec(buf[1]);
-    dateTime->hour = bcdToDec(buf[2]);
-    dateTime->dayMonth = bcdToDec(buf[3]);
-    dateTime->month = bcdToDec(buf[4]);
-    dateTime->dayWeek = bcdToDec(buf[5]);
-    dateTime->year = 2000 + bcdToDec(buf[6]);
-
-    // Check buffer for valid data
-    if ((dateTime->second > 59) ||
-        (dateTime->minute > 59) ||
-        (dateTime->hour > 23) ||
-        (dateTime->dayMonth < 1) || (dateTime->dayMonth > 31) ||
-        (dateTime->month < 1) || (dateTime->month > 12) ||
-        (dateTime->dayWeek < 1) || (dateTime->dayWeek > 7) ||
-        (dateTime->year > 2099))
-    {
-        ESP_LOGW(TAG, "dateTime->second=%d",dateTime->second);
-        ESP_LOGW(TAG, "dateTime->minute=%d",dateTime->minute);
-        ESP_LOGW(TAG, "dateTime->hour=%d",dateTime->hour);
-        ESP_LOGW(TAG, "dateTime->dayMonth=%d",dateTime->dayMonth);
-        ESP_LOGW(TAG, "dateTime->month=%d",dateTime->month);
-        ESP_LOGW(TAG, "dateTime->dayWeek=%d",dateTime->dayWeek);
-        ESP_LOGW(TAG, "dateTime->year=%d",dateTime->year);
+    for (i = 0; i < len; i++) {
+        if (fields & (1 << i)) {
+            DS1302_decodeClock(i, buf[i], dateTime);
+        }
+        zero = zero && (buf[i] == 0x00);
+    }
+
+    // All zero is also what a stuck low line reads, unless a field which cannot be zero was checked
+    if (!zero || (fields & (DS1302_FIELD_DAY_MONTH | DS1302_FIELD_MONTH | DS1302_FIELD_DAY_WEEK))) {
+        dev->link = DS1302_LINK_OK;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Set selected RTC date and time fields
+ * \param fields
+ *      DS1302_FIELD_* mask
+ * \param dateTime
+ *      Date and time structure, only the selected fields are used
+ * \note
+ *      The other fields are left untouched without reading them. When the
+ *      seconds are selected together with other fields, the clock is halted
+ *      while the fields are written, so no rollover can mix old and new values.
+ *      Without the seconds a rollover between the register writes is possible.
+ */
+void DS1302_setFields(DS1302_Dev *dev, uint8_t fields, const DS1302_DateTime *dateTime)
+{
+    uint8_t ch = 0;
+    uint8_t second = DS1302_encodeClock(DS1302_REG_SECONDS, dateTime);
+
+    fields &= DS1302_FIELD_ALL;
+
+    if (fields & DS1302_FIELD_SECOND) {
+        // Read CH bit
+        ch = (uint8_t)(DS1302_readClockRegister(dev, DS1302_REG_SECONDS) & (1 << DS1302_BIT_CH));
+        if (fields & ~DS1302_FIELD_SECOND) {
+            DS1302_writeClockRegister(dev, DS1302_REG_SECONDS, (uint8_t)((1 << DS1302_BIT_CH) | second));
+        }
+    }
+
+    for (uint8_t reg = DS1302_REG_MINUTES; reg <= DS1302_REG_YEAR; reg++) {
+        if (fields & (1 << reg)) {
+            DS1302_writeClockRegister(dev, reg, DS1302_encodeClock(reg, dateTime));
+        }
+    }
+
+    if (fields & DS1302_FIELD_SECOND) {
+        DS1302_writeClockRegister(dev, DS1302_REG_SECONDS, ch | second);
+    }
+}
+
+/*!
+ * \brief Get RTC date and time
+ * \param dateTime
+ *      Date and time structure
+ * \return
+ *      true:  Valid date and time
+ *      false: Invalid register, the burst is aborted at the first one
+ */
+bool DS1302_getDateTime(DS1302_Dev *dev, DS1302_DateTime *dateTime)
+{
+    if (!DS1302_getFields(dev, DS1302_FIELD_ALL, dateTime)) {
         memset(dateTime, 0x00, sizeof(DS1302_DateTime));
         return false;
     }
@@ -211,11 +526,10 @@ void DS1302_setTime(DS1302_Dev *dev, uint8_t hour, uint8_t minute, uint8_t secon
 {
     DS1302_DateTime dt = { 0 };
 
-    DS1302_getDateTime(dev, &dt);
     dt.hour = hour;
     dt.minute = minute;
     dt.second = second;
-    DS1302_setDateTime(dev, &dt);
+    DS1302_setFields(dev, DS1302_FIELD_TIME, &dt);
 }
 
 /*!
@@ -226,28 +540,15 @@ void DS1302_setTime(DS1302_Dev *dev, uint8_t hour, uint8_t minute, uint8_t secon
  */
 bool DS1302_getTime(DS1302_Dev *dev, uint8_t *hour, uint8_t *minute, uint8_t *second)
 {
-    uint8_t buf[3];
-
-    // Read clock time registers
-    DS1302_transferBegin(dev);
-    DS1302_writeAddrCmd(dev, DS1302_CMD_READ_CLOCK_BURST);
-    DS1302_readBuffer(dev, &buf, sizeof(buf));
-    DS1302_transferEnd(dev);
+    DS1302_DateTime dt = { 0 };
+    bool valid;
 
-    // Convert BCD buffer to Decimal
-    *second = bcdToDec(buf[0] & 0x7f); // Without CH bit from seconds register
-    *minute = bcdToDec(buf[1]);
-    *hour = bcdToDec(buf[2]);
-
-    // Check buffer for valid data
-    if ((*second > 59) || (*minute > 59) || (*hour > 23)) {
-        *second = 0x00;
-        *minute = 0x00;
-        *hour = 0x00;
-        return false;
-    }
+    valid = DS1302_getFields(dev, DS1302_FIELD_TIME, &dt);
+    *second = dt.second;
+    *minute = dt.minute;
+    *hour = dt.hour;
 
-    return true;
+    return valid;
 }
 
 /*!
@@ -322,6 +623,148 @@ void DS1302_readBufferRAM(DS1302_Dev *dev, uint8_t *buf, uint8_t len)
     DS1302_transferEnd(dev);
 }
 
+/*!
+ * \brief Start a sliced RAM burst transfer
+ * \param burst
+ *      Transfer state
+ * \param buf
+ *      Data buffer
+ * \param len
+ *      Buffer length 0x01..0x1F
+ * \param read
+ *      true:  Read RAM from address 0x00
+ *      false: Write RAM from address 0x00
+ * \note
+ *      CE stays asserted until DS1302_burstStep() returns true.
+ *      The chip tolerates any pause between bytes, so the caller may do
+ *      other work between the steps, but must not use the bus.
+ */
+void DS1302_burstBeginRAM(DS1302_Dev *dev, DS1302_Burst *burst, uint8_t *buf, uint8_t len, bool read)
+{
+    memset(burst, 0x00, sizeof(DS1302_Burst));
+    burst->dev = dev;
+    burst->buf = buf;
+    burst->len = min((int)len, NUM_DS1302_RAM_REGS);
+    burst->read = read;
+
+    DS1302_transferBegin(dev);
+    DS1302_clockOutFast(dev, read ? DS1302_CMD_READ_RAM_BURST : DS1302_CMD_WRITE_RAM_BURST, read);
+}
+
+/*!
+ * \brief Transfer the next slice of a RAM burst
+ * \param burst
+ *      Transfer state from DS1302_burstBeginRAM()
+ * \param budgetUs
+ *      Latency budget of this slice. At least one byte is transferred.
+ * \return
+ *      true:  Transfer complete, CE released
+ *      false: More slices to go
+ */
+bool DS1302_burstStep(DS1302_Burst *burst, uint32_t budgetUs)
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t elapsed = 0;
+    uint8_t count = 0;
+
+    while (burst->pos < burst->len) {
+        if (burst->read) {
+            burst->buf[burst->pos++] = DS1302_clockInFast(burst->dev);
+        } else {
+            DS1302_clockOutFast(burst->dev, burst->buf[burst->pos++], false);
+        }
+        count++;
+        elapsed = (uint32_t)(esp_timer_get_time() - start);
+
+        // Stop when the next byte would not fit into the budget
+        if (elapsed + elapsed / count > budgetUs) {
+            break;
+        }
+    }
+
+    burst->slices++;
+    burst->lastSliceUs = elapsed;
+    if (elapsed > burst->maxSliceUs) {
+        burst->maxSliceUs = elapsed;
+    }
+
+    if (burst->pos < burst->len) {
+        return false;
+    }
+
+    DS1302_transferEnd(burst->dev);
+    return true;
+}
+
+/*!
+ * \brief Capture clock registers, trickle charger and RAM
+ * \param snapshot
+ *      Raw chip state
+ * \note
+ *      Takes 3 CE cycles (clock burst, trickle charger, RAM burst).
+ *      The same state read with DS1302_getDateTime(), DS1302_isWriteProtected(),
+ *      DS1302_isHalted(), DS1302_readClockRegister() and DS1302_readBufferRAM()
+ *      takes 5 CE cycles and loses the raw register values.
+ */
+void DS1302_snapshot(DS1302_Dev *dev, DS1302_Snapshot *snapshot)
+{
+    // Clock burst including write protect register
+    DS1302_transferBegin(dev);
+    DS1302_writeAddrCmd(dev, DS1302_CMD_READ_CLOCK_BURST);
+    DS1302_readBuffer(dev, snapshot->clock, sizeof(snapshot->clock));
+    DS1302_transferEnd(dev);
+
+    // The trickle charger register is not part of the clock burst
+    snapshot->trickleCharger = DS1302_readClockRegister(dev, DS1302_REG_TC);
+
+    DS1302_transferBegin(dev);
+    DS1302_writeAddrCmd(dev, DS1302_CMD_READ_RAM_BURST);
+    DS1302_readBuffer(dev, snapshot->ram, sizeof(snapshot->ram));
+    DS1302_transferEnd(dev);
+}
+
+/*!
+ * \brief Restore clock registers, trickle charger and RAM
+ * \param snapshot
+ *      Raw chip state from DS1302_snapshot()
+ * \param restoreTime
+ *      true:  Set the clock to the captured time (4 CE cycles)
+ *      false: Keep the running time, restore only the clock halt flag (5 or 6 CE cycles)
+ * \note
+ *      The write protect flag is restored last.
+ *      Use restoreTime false for a snapshot taken before sleep, otherwise
+ *      the clock is set back by the time spent sleeping.
+ */
+void DS1302_restore(DS1302_Dev *dev, const DS1302_Snapshot *snapshot, bool restoreTime)
+{
+    // Write protect must be cleared before any other write
+    DS1302_writeClockRegister(dev, DS1302_REG_WP, 0);
+
+    DS1302_writeClockRegister(dev, DS1302_REG_TC, snapshot->trickleCharger);
+
+    DS1302_transferBegin(dev);
+    DS1302_writeAddrCmd(dev, DS1302_CMD_WRITE_RAM_BURST);
+    for (uint8_t i = 0; i < sizeof(snapshot->ram); i++) {
+        DS1302_writeByte(dev, snapshot->ram[i]);
+    }
+    DS1302_transferEnd(dev);
+
+    if (!restoreTime) {
+        // The seconds register is only written when the halt flag differs
+        DS1302_halt(dev, snapshot->clock[DS1302_REG_SECONDS] & (1 << DS1302_BIT_CH));
+        DS1302_writeClockRegister(dev, DS1302_REG_WP, snapshot->clock[DS1302_REG_WP]);
+        return;
+    }
+
+    // All 8 clock registers must be written for the burst to take effect
+    DS1302_transferBegin(dev);
+    DS1302_writeAddrCmd(dev, DS1302_CMD_WRITE_CLOCK_BURST);
+    for (uint8_t i = 0; i < sizeof(snapshot->clock); i++) {
+        DS1302_writeByte(dev, snapshot->clock[i]);
+    }
+    DS1302_transferEnd(dev);
+}
+
 // -------------------------------------------------------------------------------------------------
 /*!
  * \brief Write clock register
@@ -357,6 +800,27 @@ uint8_t DS1302_readClockRegister(DS1302_Dev *dev, uint8_t reg)
     return retval;
 }
 
+/*!
+ * \brief Read clock register with microsecond bit timing
+ * \param reg
+ *      RTC clock register (See datasheet)
+ * \return
+ *      Register value (See datasheet)
+ * \note
+ *      Takes some 40us instead of 24 ticks, for phase measurements.
+ */
+uint8_t DS1302_readClockRegisterFast(DS1302_Dev *dev, uint8_t reg)
+{
+    uint8_t retval;
+
+    DS1302_transferBegin(dev);
+    DS1302_clockOutFast(dev, (uint8_t)DS1302_CMD_READ_CLOCK_REG(reg), true);
+    retval = DS1302_clockInFast(dev);
+    DS1302_transferEnd(dev);
+
+    return retval;
+}
+
 // -------------------------------------------------------------------------------------------------
 // Private functions
 // -------------------------------------------------------------------------------------------------
@@ -365,6 +829,7 @@ uint8_t DS1302_readClockRegister(DS1302_Dev *dev, uint8_t reg)
  */
 void DS1302_transferBegin(DS1302_Dev *dev)
 {
+    dev->transfers++;
     gpio_set_level(dev->clkPin, 0);
     gpio_set_level(dev->ioPin, 0);
     gpio_set_direction(dev->ioPin, GPIO_MODE_OUTPUT);
@@ -491,4 +956,70 @@ uint8_t decToBcd(uint8_t dec)
     return ((dec / 10) << 4) + (dec % 10);
 }
 
+/*!
+ * \brief Days since 2000-01-01 of a civil date
+ * \param year
+ *      Year 2000..2099
+ * \param month
+ *      Month 1..12
+ * \param day
+ *      Day of the month 1..31
+ * \return
+ *      Number of days
+ */
+static uint32_t daysFromCivil(uint16_t year, uint8_t month, uint8_t day)
+{
+    // Shift the year so that it starts in March and Feb 29 is the last day
+    uint32_t y = (uint32_t)year - (month <= 2);
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + doe - 730425; // 730425 = days from 0000-03-01 to 2000-01-01
+}
+
+/*!
+ * \brief Date and time to epoch conversion
+ * \param dateTime
+ *      Date and time structure (dayWeek is ignored)
+ * \return
+ *      Seconds since 2000-01-01 00:00:00
+ */
+uint32_t DS1302_dateTimeToEpoch(const DS1302_DateTime *dateTime)
+{
+    uint32_t days = daysFromCivil(dateTime->year, dateTime->month, dateTime->dayMonth);
+
+    return ((days * 24 + dateTime->hour) * 60 + dateTime->minute) * 60 + dateTime->second;
+}
 
+/*!
+ * \brief Epoch to date and time conversion
+ * \param epoch
+ *      Seconds since 2000-01-01 00:00:00
+ * \param dateTime
+ *      Date and time structure (dayWeek 1 as Monday .. 7 as Sunday)
+ */
+void DS1302_epochToDateTime(uint32_t epoch, DS1302_DateTime *dateTime)
+{
+    uint32_t days = epoch / 86400;
+    uint32_t secs = epoch % 86400;
+
+    dateTime->second = secs % 60;
+    dateTime->minute = (secs / 60) % 60;
+    dateTime->hour = secs / 3600;
+    dateTime->dayWeek = (uint8_t)((days + 5) % 7 + 1); // 2000-01-01 was a Saturday
+
+    // Inverse of daysFromCivil()
+    uint32_t z = days + 730425;
+    uint32_t era = z / 146097;
+    uint32_t doe = z - era * 146097;
+    uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    uint32_t mp = (5 * doy + 2) / 153;
+    uint32_t month = mp < 10 ? mp + 3 : mp - 9;
+
+    dateTime->dayMonth = (uint8_t)(doy - (153 * mp + 2) / 5 + 1);
+    dateTime->month = (uint8_t)month;
+    dateTime->year = (uint16_t)(yoe + era * 400 + (month <= 2));
+}
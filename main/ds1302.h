@@ -7,6 +7,19 @@
 #ifndef MAIN_DS1302_H_
 #define MAIN_DS1302_H_
 
+#include "sdkconfig.h"
+
+//! Driver logging and scratch buffers, see CONFIG_DS1302_MINIMAL_FOOTPRINT
+#if CONFIG_DS1302_MINIMAL_FOOTPRINT
+#define DS1302_DEBUG(tag, ...)  do { } while (0)
+#define DS1302_WARN(tag, ...)   do { } while (0)
+#define DS1302_SCRATCH          static
+#else
+#define DS1302_DEBUG(tag, ...)  ESP_LOGD(tag, __VA_ARGS__)
+#define DS1302_WARN(tag, ...)   ESP_LOGW(tag, __VA_ARGS__)
+#define DS1302_SCRATCH
+#endif
+
 //! DS1302 address/command register
 #define DS1302_ACB              0x80    //!< Address command date/time
 #define DS1302_ACB_RAM          0x40    //!< Address command RAM
@@ -42,6 +55,18 @@
 #define DS1302_REG_WP           0x07    //!< Write protect register
 #define DS1302_REG_TC           0x08    //!< Tickle Charger register
 
+//! DS1302 clock field masks (bit number is the register number)
+#define DS1302_FIELD_SECOND     (1 << DS1302_REG_SECONDS)   //!< Second
+#define DS1302_FIELD_MINUTE     (1 << DS1302_REG_MINUTES)   //!< Minute
+#define DS1302_FIELD_HOUR       (1 << DS1302_REG_HOURS)     //!< Hour
+#define DS1302_FIELD_DAY_MONTH  (1 << DS1302_REG_DAY_MONTH) //!< Day of the month
+#define DS1302_FIELD_MONTH      (1 << DS1302_REG_MONTH)     //!< Month
+#define DS1302_FIELD_DAY_WEEK   (1 << DS1302_REG_DAY_WEEK)  //!< Day of the week
+#define DS1302_FIELD_YEAR       (1 << DS1302_REG_YEAR)      //!< Year
+#define DS1302_FIELD_TIME       (DS1302_FIELD_SECOND | DS1302_FIELD_MINUTE | DS1302_FIELD_HOUR)
+#define DS1302_FIELD_DATE       (DS1302_FIELD_DAY_MONTH | DS1302_FIELD_MONTH | DS1302_FIELD_YEAR)
+#define DS1302_FIELD_ALL        0x7F
+
 //! DS1302 number of RAM registers
 #define NUM_DS1302_RAM_REGS     31
 
@@ -61,30 +86,70 @@ typedef struct {
     uint8_t second;     //!< Second 0..59
     uint8_t minute;     //!< Minute 0..59
     uint8_t hour;       //!< Hour 0..23
-    uint8_t dayWeek;    //!< Day of the week (0 as Sunday/ 1 as Monday)
+    uint8_t dayWeek;    //!< Day of the week (1 as Monday .. 7 as Sunday)
     uint8_t dayMonth;   //!< Day of the month 1..31
     uint8_t month;      //!< Month 1..12
     uint16_t year;      //!< Year 2000..2099
 } DS1302_DateTime;
 
+/*!
+ * \brief Bus link state
+ */
+typedef enum {
+    DS1302_LINK_OK = 0,         //!< Bus working
+    DS1302_LINK_STUCK_HIGH,     //!< IO reads always 1 (not connected or shorted to VCC)
+    DS1302_LINK_STUCK_LOW,      //!< IO reads always 0 (shorted to GND or chip not powered)
+    DS1302_LINK_BIT_ERROR,      //!< Canary read back with wrong bits (shorted lines or noise)
+} DS1302_Link;
+
 typedef struct {
     uint8_t clkPin;     //!< GPIO for clk
     uint8_t ioPin;      //!< GPIO for io
     uint8_t cePin;      //!< GPIO for ce
+    uint32_t transfers; //!< Number of CE cycles since DS1302_begin()
+    DS1302_Link link;   //!< Last detected link state, DS1302_LINK_OK after a valid clock read which is not all zero
 } DS1302_Dev;
 
+/*!
+ * \brief Sliced RAM burst transfer state
+ */
+typedef struct {
+    DS1302_Dev *dev;        //!< Device
+    uint8_t *buf;           //!< Data buffer
+    uint8_t len;            //!< Number of bytes to transfer
+    uint8_t pos;            //!< Number of bytes transferred
+    bool read;              //!< true: read RAM, false: write RAM
+    uint8_t slices;         //!< Number of slices so far
+    uint32_t lastSliceUs;   //!< Duration of the last slice
+    uint32_t maxSliceUs;    //!< Duration of the longest slice
+} DS1302_Burst;
+
+/*!
+ * \brief Raw chip state
+ */
+typedef struct __attribute__((packed)) {
+    uint8_t clock[8];       //!< Clock registers 0x00..0x07 including CH and WP
+    uint8_t trickleCharger; //!< Trickle charger register
+    uint8_t ram[NUM_DS1302_RAM_REGS]; //!< RAM 0x00..0x1E
+} DS1302_Snapshot;
+
 bool DS1302_begin(DS1302_Dev *dev, uint8_t clkPin, uint8_t ioPin, uint8_t cePin);
+DS1302_Link DS1302_linkProbe(DS1302_Dev *dev);
+DS1302_Link DS1302_linkCheck(DS1302_Dev *dev);
 void DS1302_writeProtect(DS1302_Dev *dev, bool enable);
 bool DS1302_isWriteProtected(DS1302_Dev *dev);
 void DS1302_halt(DS1302_Dev *dev, bool halt);
 bool DS1302_isHalted(DS1302_Dev *dev);
 void DS1302_setDateTime(DS1302_Dev *dev, DS1302_DateTime *dateTime);
 bool DS1302_getDateTime(DS1302_Dev *dev, DS1302_DateTime *dateTime);
+bool DS1302_getFields(DS1302_Dev *dev, uint8_t fields, DS1302_DateTime *dateTime);
+void DS1302_setFields(DS1302_Dev *dev, uint8_t fields, const DS1302_DateTime *dateTime);
 void DS1302_setTime(DS1302_Dev *dev, uint8_t hour, uint8_t minute, uint8_t second);
 bool DS1302_getTime(DS1302_Dev *dev, uint8_t *hour, uint8_t *minute, uint8_t *second);
 
 void DS1302_writeClockRegister(DS1302_Dev *dev, uint8_t reg, uint8_t value);
 uint8_t DS1302_readClockRegister(DS1302_Dev *dev, uint8_t reg);
+uint8_t DS1302_readClockRegisterFast(DS1302_Dev *dev, uint8_t reg);
 
 void DS1302_writeByteRAM(DS1302_Dev *dev, uint8_t addr, uint8_t value);
 void DS1302_writeBufferRAM(DS1302_Dev *dev, uint8_t *buf, uint8_t len);
@@ -92,6 +157,12 @@ void DS1302_writeBufferRAM(DS1302_Dev *dev, uint8_t *buf, uint8_t len);
 uint8_t DS1302_readByteRAM(DS1302_Dev *dev, uint8_t addr);
 void DS1302_readBufferRAM(DS1302_Dev *dev, uint8_t *buf, uint8_t len);
 
+void DS1302_burstBeginRAM(DS1302_Dev *dev, DS1302_Burst *burst, uint8_t *buf, uint8_t len, bool read);
+bool DS1302_burstStep(DS1302_Burst *burst, uint32_t budgetUs);
+
+void DS1302_snapshot(DS1302_Dev *dev, DS1302_Snapshot *snapshot);
+void DS1302_restore(DS1302_Dev *dev, const DS1302_Snapshot *snapshot, bool restoreTime);
+
 // RTC interface functions
 void DS1302_transferBegin(DS1302_Dev *dev);
 void DS1302_transferEnd(DS1302_Dev *dev);
@@ -104,5 +175,9 @@ void DS1302_readBuffer(DS1302_Dev *dev, void *buf, uint8_t len);
 uint8_t bcdToDec(uint8_t bcd);
 uint8_t decToBcd(uint8_t dec);
 
+// Epoch conversions (seconds since 2000-01-01 00:00:00)
+uint32_t DS1302_dateTimeToEpoch(const DS1302_DateTime *dateTime);
+void DS1302_epochToDateTime(uint32_t epoch, DS1302_DateTime *dateTime);
+
 #endif // MAIN_DS1302_H_
 
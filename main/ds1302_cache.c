@@ -0,0 +1,303 @@
+/*
+ * Write-back cache for the DS1302.
+ *
+ * Pending clock fields are written with DS1302_setFields(), or with one
+ * clock burst when all fields are pending. Pending RAM bytes are written
+ * either one by one or with one RAM burst up to the highest pending byte,
+ * whichever takes fewer bus clocks. A burst needs all bytes below the
+ * highest pending one, unknown bytes are fetched with one burst read first.
+ *
+ * The cache assumes it is the only writer of the chip.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ds1302_cache.h"
+
+#define TAG "DS1302_CACHE"
+
+//! Bus clocks of a single byte transaction (command and data)
+#define CLOCKS_SINGLE       16
+
+/*!
+ * \brief CE cycles DS1302_setFields() takes
+ */
+static uint32_t fieldsTransfers(uint8_t fields)
+{
+    uint32_t count = 0;
+
+    for (uint8_t reg = DS1302_REG_MINUTES; reg <= DS1302_REG_YEAR; reg++) {
+        if (fields & (1 << reg)) {
+            count++;
+        }
+    }
+    if (fields & DS1302_FIELD_SECOND) {
+        count += (fields & ~DS1302_FIELD_SECOND) ? 3 : 2;
+    }
+
+    return count;
+}
+
+/*!
+ * \brief Start the flush deadline with the first pending write
+ */
+static void DS1302_cacheTouch(DS1302_Cache *cache)
+{
+    if (cache->deadline == 0) {
+        cache->deadline = esp_timer_get_time() + cache->flushDelayUs;
+    }
+}
+
+/*!
+ * \brief Add the time passed since the clock write to the pending fields
+ */
+static void DS1302_cacheAge(DS1302_Cache *cache)
+{
+    const uint8_t dateTime = DS1302_FIELD_TIME | DS1302_FIELD_DATE;
+    uint32_t elapsed = (uint32_t)((esp_timer_get_time() - cache->clockStamp) / 1000000);
+    DS1302_DateTime *dt = &cache->clock;
+    uint8_t dayWeek = dt->dayWeek;
+    uint32_t before;
+    uint32_t after;
+
+    if (elapsed == 0) {
+        return;
+    }
+    // Keep the fraction of a second for the next call
+    cache->clockStamp += (int64_t)elapsed * 1000000;
+
+    if ((cache->clockFields & dateTime) == dateTime) {
+        before = DS1302_dateTimeToEpoch(dt);
+        after = before + elapsed;
+        DS1302_epochToDateTime(after, dt);
+        // Keep the day of the week numbering of the caller
+        dt->dayWeek = (uint8_t)((dayWeek + 6 + (after / 86400 - before / 86400)) % 7 + 1);
+    } else if ((cache->clockFields & DS1302_FIELD_TIME) == DS1302_FIELD_TIME) {
+        // No date to carry into
+        after = ((dt->hour * 60 + dt->minute) * 60 + dt->second + elapsed) % 86400;
+        dt->second = after % 60;
+        dt->minute = (after / 60) % 60;
+        dt->hour = after / 3600;
+    }
+}
+
+/*!
+ * \brief Write the pending clock fields
+ */
+static void DS1302_cacheFlushClock(DS1302_Cache *cache)
+{
+    if (cache->clockFields == 0) {
+        return;
+    }
+
+    DS1302_cacheAge(cache);
+    if (cache->clockFields == DS1302_FIELD_ALL) {
+        DS1302_setDateTime(cache->dev, &cache->clock);
+    } else {
+        DS1302_setFields(cache->dev, cache->clockFields, &cache->clock);
+    }
+    cache->clockFields = 0;
+}
+
+/*!
+ * \brief Write the pending RAM bytes
+ */
+static void DS1302_cacheFlushRAM(DS1302_Cache *cache)
+{
+    DS1302_SCRATCH uint8_t buf[NUM_DS1302_RAM_REGS];
+    uint32_t single = 0;
+    uint32_t burst;
+    uint32_t below;
+    uint8_t len = 0;
+
+    if (cache->ramDirty == 0) {
+        return;
+    }
+
+    for (uint8_t i = 0; i < NUM_DS1302_RAM_REGS; i++) {
+        if (cache->ramDirty & (1UL << i)) {
+            single += CLOCKS_SINGLE;
+            len = i + 1;
+        }
+    }
+
+    // A burst takes the command and len bytes, twice when unknown bytes must be read first
+    below = (len < 32) ? ((1UL << len) - 1) : 0xFFFFFFFF;
+    burst = 8 + 8 * len;
+    if ((cache->ramValid & below) != below) {
+        burst *= 2;
+    }
+
+    if (burst < single) {
+        if ((cache->ramValid & below) != below) {
+            DS1302_readBufferRAM(cache->dev, buf, len);
+            for (uint8_t i = 0; i < len; i++) {
+                if (!(cache->ramDirty & (1UL << i))) {
+                    cache->ram[i] = buf[i];
+                }
+            }
+            cache->ramValid |= below;
+        }
+        DS1302_writeBufferRAM(cache->dev, cache->ram, len);
+    } else {
+        for (uint8_t i = 0; i < len; i++) {
+            if (cache->ramDirty & (1UL << i)) {
+                DS1302_writeByteRAM(cache->dev, i, cache->ram[i]);
+            }
+        }
+    }
+    cache->ramDirty = 0;
+}
+
+/*!
+ * \brief Initialize the write-back cache
+ * \param dev
+ *      Initialized DS1302 device
+ * \param flushDelayMs
+ *      Longest time a write stays pending before DS1302_cachePoll() flushes it
+ */
+void DS1302_cacheBegin(DS1302_Cache *cache, DS1302_Dev *dev, uint32_t flushDelayMs)
+{
+    memset(cache, 0x00, sizeof(DS1302_Cache));
+    cache->dev = dev;
+    cache->flushDelayUs = flushDelayMs * 1000;
+}
+
+/*!
+ * \brief Set selected RTC date and time fields
+ * \param fields
+ *      DS1302_FIELD_* mask
+ * \param dateTime
+ *      Date and time structure, only the selected fields are used
+ * \note
+ *      Replaces earlier pending values of the same fields. The time passed
+ *      until the flush is added when all time fields are selected.
+ */
+void DS1302_cacheSetFields(DS1302_Cache *cache, uint8_t fields, const DS1302_DateTime *dateTime)
+{
+    DS1302_DateTime *dt = &cache->clock;
+
+    DS1302_cacheAge(cache);
+    if (((fields & DS1302_FIELD_TIME) == DS1302_FIELD_TIME) ||
+        ((cache->clockFields & DS1302_FIELD_TIME) != DS1302_FIELD_TIME))
+    {
+        // The new time starts now, otherwise the pending time keeps running
+        cache->clockStamp = esp_timer_get_time();
+    }
+    if (fields & DS1302_FIELD_SECOND) dt->second = dateTime->second;
+    if (fields & DS1302_FIELD_MINUTE) dt->minute = dateTime->minute;
+    if (fields & DS1302_FIELD_HOUR) dt->hour = dateTime->hour;
+    if (fields & DS1302_FIELD_DAY_MONTH) dt->dayMonth = dateTime->dayMonth;
+    if (fields & DS1302_FIELD_MONTH) dt->month = dateTime->month;
+    if (fields & DS1302_FIELD_DAY_WEEK) dt->dayWeek = dateTime->dayWeek;
+    if (fields & DS1302_FIELD_YEAR) dt->year = dateTime->year;
+    cache->clockFields |= fields & DS1302_FIELD_ALL;
+
+    cache->requested += (fields == DS1302_FIELD_ALL) ? 2 : fieldsTransfers(fields);
+    DS1302_cacheTouch(cache);
+}
+
+/*!
+ * \brief Set RTC date and time
+ * \param dateTime
+ *      Date time structure
+ */
+void DS1302_cacheSetDateTime(DS1302_Cache *cache, const DS1302_DateTime *dateTime)
+{
+    DS1302_cacheSetFields(cache, DS1302_FIELD_ALL, dateTime);
+}
+
+/*!
+ * \brief Get RTC date and time
+ * \param dateTime
+ *      Date and time structure
+ * \return
+ *      true:  Valid date and time
+ *      false: Invalid register
+ * \note
+ *      Pending clock fields are flushed first, so the result includes them.
+ */
+bool DS1302_cacheGetDateTime(DS1302_Cache *cache, DS1302_DateTime *dateTime)
+{
+    uint32_t transfers = cache->dev->transfers;
+
+    DS1302_cacheFlushClock(cache);
+    cache->issued += cache->dev->transfers - transfers;
+
+    return DS1302_getDateTime(cache->dev, dateTime);
+}
+
+/*!
+ * \brief Write a byte to RAM
+ * \param addr
+ *      RAM address 0..0x1E
+ * \param value
+ *      RAM byte 0..0xFF
+ */
+void DS1302_cacheWriteByteRAM(DS1302_Cache *cache, uint8_t addr, uint8_t value)
+{
+    if (addr >= NUM_DS1302_RAM_REGS) {
+        return;
+    }
+
+    cache->ram[addr] = value;
+    cache->ramDirty |= 1UL << addr;
+    cache->ramValid |= 1UL << addr;
+
+    cache->requested++;
+    DS1302_cacheTouch(cache);
+}
+
+/*!
+ * \brief Read byte from RAM
+ * \param addr
+ *      RAM address 0..0x1E
+ * \return
+ *      RAM byte 0..0xFF, pending writes included
+ */
+uint8_t DS1302_cacheReadByteRAM(DS1302_Cache *cache, uint8_t addr)
+{
+    if (addr >= NUM_DS1302_RAM_REGS) {
+        return 0;
+    }
+
+    if (!(cache->ramValid & (1UL << addr))) {
+        cache->ram[addr] = DS1302_readByteRAM(cache->dev, addr);
+        cache->ramValid |= 1UL << addr;
+    }
+
+    return cache->ram[addr];
+}
+
+/*!
+ * \brief Flush when the deadline has passed
+ * \note
+ *      Call periodically from the task which owns the bus.
+ */
+void DS1302_cachePoll(DS1302_Cache *cache)
+{
+    if (cache->deadline && (esp_timer_get_time() >= cache->deadline)) {
+        DS1302_cacheFlush(cache);
+    }
+}
+
+/*!
+ * \brief Write all pending clock fields and RAM bytes
+ * \note
+ *      Call before deep sleep or power down.
+ */
+void DS1302_cacheFlush(DS1302_Cache *cache)
+{
+    uint32_t transfers = cache->dev->transfers;
+
+    DS1302_cacheFlushClock(cache);
+    DS1302_cacheFlushRAM(cache);
+    cache->deadline = 0;
+
+    cache->issued += cache->dev->transfers - transfers;
+    DS1302_DEBUG(TAG, "flush requested=%d issued=%d", (int)cache->requested, (int)cache->issued);
+}
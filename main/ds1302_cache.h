@@ -0,0 +1,41 @@
+/*
+ * Write-back cache for the DS1302.
+ * Clock and RAM writes are collected in memory and flushed with the
+ * fewest transactions on a deadline or on an explicit flush.
+ */
+
+#ifndef MAIN_DS1302_CACHE_H_
+#define MAIN_DS1302_CACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ds1302.h"
+
+/*!
+ * \brief Write-back cache state
+ */
+typedef struct {
+    DS1302_Dev *dev;            //!< Device
+    uint32_t flushDelayUs;      //!< Longest time a write stays pending
+    int64_t deadline;           //!< Time of the next flush (0 as nothing pending)
+    DS1302_DateTime clock;      //!< Pending clock fields
+    uint8_t clockFields;        //!< DS1302_FIELD_* mask of pending clock fields
+    int64_t clockStamp;         //!< Time the pending clock fields refer to
+    uint8_t ram[NUM_DS1302_RAM_REGS];   //!< RAM contents
+    uint32_t ramDirty;          //!< Bit n: ram[n] pending
+    uint32_t ramValid;          //!< Bit n: ram[n] known
+    uint32_t requested;         //!< CE cycles the writes would have taken without the cache
+    uint32_t issued;            //!< CE cycles taken by the flushes
+} DS1302_Cache;
+
+void DS1302_cacheBegin(DS1302_Cache *cache, DS1302_Dev *dev, uint32_t flushDelayMs);
+void DS1302_cacheSetFields(DS1302_Cache *cache, uint8_t fields, const DS1302_DateTime *dateTime);
+void DS1302_cacheSetDateTime(DS1302_Cache *cache, const DS1302_DateTime *dateTime);
+bool DS1302_cacheGetDateTime(DS1302_Cache *cache, DS1302_DateTime *dateTime);
+void DS1302_cacheWriteByteRAM(DS1302_Cache *cache, uint8_t addr, uint8_t value);
+uint8_t DS1302_cacheReadByteRAM(DS1302_Cache *cache, uint8_t addr);
+void DS1302_cachePoll(DS1302_Cache *cache);
+void DS1302_cacheFlush(DS1302_Cache *cache);
+
+#endif // MAIN_DS1302_CACHE_H_
@@ -0,0 +1,453 @@
+/*
+ * Timestamped event log in the DS1302 RAM.
+ *
+ * RAM layout
+ *  0x00     Magic
+ *  0x01..07 Header slot 0
+ *  0x08..0E Header slot 1
+ *  0x0F..1E Data area, ring of records
+ *
+ * Header slot layout
+ *  +0       Tail, offset of the oldest record in the data area (bits 4..0),
+ *           generation (bits 7..6)
+ *  +1       Number of data bytes in use
+ *  +2..5    Base epoch, little endian
+ *  +6       Check, complement of the sum of the magic, the slot and the
+ *           data in use
+ *
+ * A record is the event code and the seconds since the previous event.
+ * The first byte holds the code (bits 7..5), a continuation flag (bit 4)
+ * and the low 4 bits of the delta. Each continuation byte holds 7 more
+ * bits of the delta and a continuation flag (bit 7). Events less than
+ * 16 seconds apart take a single byte.
+ *
+ * The base epoch is the time the delta of the oldest record refers to.
+ * When the oldest record is dropped, its delta is added to the base.
+ *
+ * The valid slot of the newer generation is the active one. A commit
+ * writes the new header into the other slot and its check last, so it
+ * takes effect with a single byte write. An append writes the record into
+ * bytes which are free for the active slot before committing. When the
+ * log is full, the dropped records are committed first, the record then
+ * goes into bytes which are free for that slot. An interruption at any
+ * point leaves the old log, the log without the dropped records, or the
+ * new log.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "ds1302_log.h"
+
+#define TAG "DS1302_LOG"
+
+#define LOG_MAGIC       0xE5
+#define LOG_SLOT_SIZE   7
+#define LOG_SLOT(n)     (1 + (n) * LOG_SLOT_SIZE)
+#define LOG_TAIL        0
+#define LOG_USED        1
+#define LOG_BASE        2
+#define LOG_CHECK       6
+#define LOG_TAIL_MASK   0x1F
+#define LOG_GEN_SHIFT   6
+#define LOG_DATA        LOG_SLOT(2)
+#define LOG_DATA_SIZE   (NUM_DS1302_RAM_REGS - LOG_DATA)
+#define LOG_MAX_RECORD  5
+
+static uint8_t logTail(const uint8_t *img, uint8_t slot)
+{
+    return img[LOG_SLOT(slot) + LOG_TAIL] & LOG_TAIL_MASK;
+}
+
+static uint8_t logGen(const uint8_t *img, uint8_t slot)
+{
+    return img[LOG_SLOT(slot) + LOG_TAIL] >> LOG_GEN_SHIFT;
+}
+
+static uint8_t logUsed(const uint8_t *img, uint8_t slot)
+{
+    return img[LOG_SLOT(slot) + LOG_USED];
+}
+
+static uint32_t logGetBase(const uint8_t *img, uint8_t slot)
+{
+    const uint8_t *base = &img[LOG_SLOT(slot) + LOG_BASE];
+
+    return (uint32_t)base[0] |
+           ((uint32_t)base[1] << 8) |
+           ((uint32_t)base[2] << 16) |
+           ((uint32_t)base[3] << 24);
+}
+
+/*!
+ * \brief Check of a header slot and the data bytes it uses
+ */
+static uint8_t logCheck(const uint8_t *img, uint8_t slot)
+{
+    uint8_t sum = LOG_MAGIC;
+
+    for (uint8_t i = 0; i < LOG_CHECK; i++) {
+        sum += img[LOG_SLOT(slot) + i];
+    }
+    for (uint8_t i = 0; i < logUsed(img, slot); i++) {
+        sum += img[LOG_DATA + (logTail(img, slot) + i) % LOG_DATA_SIZE];
+    }
+
+    return (uint8_t)~sum;
+}
+
+/*!
+ * \brief Fill a header slot
+ */
+static void logSetSlot(uint8_t *img, uint8_t slot, uint8_t gen, uint8_t tail, uint8_t used, uint32_t base)
+{
+    uint8_t *hdr = &img[LOG_SLOT(slot)];
+
+    hdr[LOG_TAIL] = (uint8_t)((gen << LOG_GEN_SHIFT) | tail);
+    hdr[LOG_USED] = used;
+    for (uint8_t i = 0; i < 4; i++) {
+        hdr[LOG_BASE + i] = (uint8_t)(base >> (8 * i));
+    }
+    hdr[LOG_CHECK] = logCheck(img, slot);
+}
+
+/*!
+ * \brief Decode one record
+ * \param img
+ *      RAM image
+ * \param offset
+ *      Offset of the record in the data area
+ * \param avail
+ *      Number of bytes left in use
+ * \param code
+ *      Event code
+ * \param delta
+ *      Seconds since the previous event
+ * \return
+ *      Record length, 0 when the record is invalid
+ */
+static uint8_t logDecode(const uint8_t *img, uint8_t offset, uint8_t avail, uint8_t *code, uint32_t *delta)
+{
+    uint8_t value;
+    uint8_t len = 1;
+    uint8_t shift = 4;
+
+    if (avail == 0) {
+        return 0;
+    }
+
+    value = img[LOG_DATA + offset];
+    *code = value >> 5;
+    *delta = value & 0x0F;
+    if (*code == 0) {
+        return 0;
+    }
+
+    while (value & ((len == 1) ? 0x10 : 0x80)) {
+        if ((len >= avail) || (len >= LOG_MAX_RECORD)) {
+            return 0;
+        }
+        value = img[LOG_DATA + (offset + len) % LOG_DATA_SIZE];
+        *delta |= (uint32_t)(value & 0x7F) << shift;
+        shift += 7;
+        len++;
+    }
+
+    return len;
+}
+
+/*!
+ * \brief Encode one record
+ * \return
+ *      Record length
+ */
+static uint8_t logEncode(uint8_t *rec, uint8_t code, uint32_t delta)
+{
+    uint8_t len = 1;
+
+    rec[0] = (uint8_t)((code << 5) | (delta & 0x0F));
+    delta >>= 4;
+    if (delta) {
+        rec[0] |= 0x10;
+    }
+    while (delta) {
+        rec[len] = delta & 0x7F;
+        delta >>= 7;
+        if (delta) {
+            rec[len] |= 0x80;
+        }
+        len++;
+    }
+
+    return len;
+}
+
+/*!
+ * \brief Decode the records in use by a header slot
+ * \param img
+ *      RAM image
+ * \param slot
+ *      Header slot
+ * \param events
+ *      Decoded events, oldest first (may be NULL)
+ * \param last
+ *      Epoch of the newest event, or the base when the log is empty
+ * \return
+ *      Number of events, -1 when a record is invalid
+ */
+static int logWalk(const uint8_t *img, uint8_t slot, DS1302_LogEvent *events, uint32_t *last)
+{
+    uint8_t tail = logTail(img, slot);
+    uint8_t used = logUsed(img, slot);
+    uint32_t epoch = logGetBase(img, slot);
+    uint8_t code;
+    uint32_t delta;
+    uint8_t len;
+    int count = 0;
+
+    while (used) {
+        len = logDecode(img, tail, used, &code, &delta);
+        if (len == 0) {
+            return -1;
+        }
+        epoch += delta;
+        if (events) {
+            events[count].code = code;
+            events[count].epoch = epoch;
+        }
+        count++;
+        tail = (tail + len) % LOG_DATA_SIZE;
+        used -= len;
+    }
+
+    *last = epoch;
+    return count;
+}
+
+static bool logSlotValid(const uint8_t *img, uint8_t slot)
+{
+    uint32_t last;
+
+    return (logTail(img, slot) < LOG_DATA_SIZE) &&
+           (logUsed(img, slot) <= LOG_DATA_SIZE) &&
+           (img[LOG_SLOT(slot) + LOG_CHECK] == logCheck(img, slot)) &&
+           (logWalk(img, slot, NULL, &last) >= 0);
+}
+
+/*!
+ * \brief Check a RAM image and decode its events
+ * \param img
+ *      RAM image
+ * \param events
+ *      Decoded events, oldest first (may be NULL)
+ * \param last
+ *      Epoch of the newest event, or the base when the log is empty
+ * \param slot
+ *      Active header slot
+ * \return
+ *      Number of events, -1 when the image is not a valid log
+ */
+static int logParse(const uint8_t *img, DS1302_LogEvent *events, uint32_t *last, uint8_t *slot)
+{
+    bool valid0;
+    bool valid1;
+
+    if (img[0] != LOG_MAGIC) {
+        return -1;
+    }
+
+    valid0 = logSlotValid(img, 0);
+    valid1 = logSlotValid(img, 1);
+    if (valid0 && valid1) {
+        // Slot 1 was committed after slot 0
+        *slot = (((logGen(img, 1) - logGen(img, 0)) & 0x03) == 1) ? 1 : 0;
+    } else if (valid0 || valid1) {
+        *slot = valid1 ? 1 : 0;
+        DS1302_DEBUG(TAG, "slot %d only", *slot);
+    } else {
+        return -1;
+    }
+
+    return logWalk(img, *slot, events, last);
+}
+
+/*!
+ * \brief Write the bytes which differ between two RAM images
+ * \param old
+ *      Current RAM contents
+ * \param img
+ *      New RAM contents
+ * \note
+ *      Data bytes are written first, then the header slots and their
+ *      checks last.
+ */
+static void logCommit(DS1302_Dev *dev, const uint8_t *old, const uint8_t *img)
+{
+    uint8_t changed = 0;
+
+    for (uint8_t i = 0; i < NUM_DS1302_RAM_REGS; i++) {
+        if (old[i] != img[i]) {
+            changed++;
+        }
+    }
+
+    // A burst write of all bytes is cheaper than 16 single byte writes
+    if (changed >= 16) {
+        DS1302_writeBufferRAM(dev, (uint8_t *)img, NUM_DS1302_RAM_REGS);
+        return;
+    }
+
+    for (uint8_t i = LOG_DATA; i < NUM_DS1302_RAM_REGS; i++) {
+        if (old[i] != img[i]) {
+            DS1302_writeByteRAM(dev, i, img[i]);
+        }
+    }
+    for (uint8_t i = 0; i < LOG_DATA; i++) {
+        if (((i - LOG_SLOT(0)) % LOG_SLOT_SIZE != LOG_CHECK) && (old[i] != img[i])) {
+            DS1302_writeByteRAM(dev, i, img[i]);
+        }
+    }
+    for (uint8_t slot = 0; slot < 2; slot++) {
+        uint8_t i = LOG_SLOT(slot) + LOG_CHECK;
+        if (old[i] != img[i]) {
+            DS1302_writeByteRAM(dev, i, img[i]);
+        }
+    }
+}
+
+/*!
+ * \brief Build an empty log image, slot 1 is left invalid
+ */
+static void logInit(uint8_t *img, uint32_t base)
+{
+    memset(img, 0x00, NUM_DS1302_RAM_REGS);
+    img[0] = LOG_MAGIC;
+    logSetSlot(img, 0, 0, 0, 0, base);
+}
+
+/*!
+ * \brief Erase the log
+ */
+void DS1302_logFormat(DS1302_Dev *dev)
+{
+    DS1302_SCRATCH uint8_t img[NUM_DS1302_RAM_REGS];
+
+    logInit(img, 0);
+    DS1302_writeBufferRAM(dev, img, sizeof(img));
+}
+
+/*!
+ * \brief Append an event
+ * \param code
+ *      Event code 1..7
+ * \param epoch
+ *      Seconds since 2000-01-01 00:00:00
+ * \return
+ *      true:  Event stored, the oldest events are dropped when the log is full
+ *      false: Invalid code or epoch older than the newest event
+ * \note
+ *      A corrupted log is erased before the event is stored.
+ */
+bool DS1302_logAppend(DS1302_Dev *dev, uint8_t code, uint32_t epoch)
+{
+    DS1302_SCRATCH uint8_t old[NUM_DS1302_RAM_REGS];
+    DS1302_SCRATCH uint8_t img[NUM_DS1302_RAM_REGS];
+    uint8_t rec[LOG_MAX_RECORD];
+    uint8_t slot;
+    uint8_t len;
+    uint8_t tail;
+    uint8_t used;
+    uint8_t gen;
+    uint32_t base;
+    uint32_t last;
+    uint32_t delta;
+    uint8_t oldCode;
+
+    if ((code == 0) || (code > DS1302_LOG_MAX_CODE)) {
+        return false;
+    }
+
+    DS1302_readBufferRAM(dev, old, sizeof(old));
+    memcpy(img, old, sizeof(img));
+
+    if (logParse(img, NULL, &last, &slot) < 0) {
+        DS1302_WARN(TAG, "log corrupted, erased");
+        logInit(img, epoch);
+        slot = 0;
+        last = epoch;
+    }
+    tail = logTail(img, slot);
+    used = logUsed(img, slot);
+    gen = logGen(img, slot);
+    base = logGetBase(img, slot);
+    if (used == 0) {
+        // The first event refers to itself
+        base = epoch;
+        last = epoch;
+    }
+    if (epoch < last) {
+        return false;
+    }
+
+    len = logEncode(rec, code, epoch - last);
+
+    // Drop the oldest records until the new one fits
+    if (LOG_DATA_SIZE - used < len) {
+        while (LOG_DATA_SIZE - used < len) {
+            uint8_t oldLen = logDecode(img, tail, used, &oldCode, &delta);
+            base += delta;
+            tail = (tail + oldLen) % LOG_DATA_SIZE;
+            used -= oldLen;
+        }
+        slot ^= 1;
+        gen = (gen + 1) & 0x03;
+        logSetSlot(img, slot, gen, tail, used, base);
+        logCommit(dev, old, img);
+        memcpy(old, img, sizeof(old));
+    }
+
+    // The record goes into free space, the other slot commits it
+    for (uint8_t i = 0; i < len; i++) {
+        img[LOG_DATA + (tail + used + i) % LOG_DATA_SIZE] = rec[i];
+    }
+    slot ^= 1;
+    gen = (gen + 1) & 0x03;
+    logSetSlot(img, slot, gen, tail, used + len, base);
+
+    logCommit(dev, old, img);
+
+    return true;
+}
+
+/*!
+ * \brief Read the events with a single burst read
+ * \param events
+ *      Events, oldest first
+ * \param maxEvents
+ *      Size of events. When the log holds more, the newest are returned.
+ * \return
+ *      Number of events, -1 when the log is corrupted or not formatted
+ */
+int DS1302_logRead(DS1302_Dev *dev, DS1302_LogEvent *events, int maxEvents)
+{
+    DS1302_SCRATCH uint8_t img[NUM_DS1302_RAM_REGS];
+    DS1302_SCRATCH DS1302_LogEvent all[DS1302_LOG_MAX_EVENTS];
+    uint32_t last;
+    uint8_t slot;
+    int count;
+    int skip;
+
+    DS1302_readBufferRAM(dev, img, sizeof(img));
+
+    count = logParse(img, all, &last, &slot);
+    if (count < 0) {
+        return -1;
+    }
+
+    skip = (count > maxEvents) ? count - maxEvents : 0;
+    memcpy(events, &all[skip], (count - skip) * sizeof(DS1302_LogEvent));
+
+    return count - skip;
+}
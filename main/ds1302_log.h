@@ -0,0 +1,35 @@
+/*
+ * Timestamped event log in the DS1302 RAM.
+ * The log occupies the whole 31 bytes of RAM.
+ */
+
+#ifndef MAIN_DS1302_LOG_H_
+#define MAIN_DS1302_LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ds1302.h"
+
+//! Event codes 1..7 (0 is not a valid code)
+#define DS1302_LOG_POWER_FAIL   1       //!< Power fail
+#define DS1302_LOG_RESET        2       //!< Reset
+#define DS1302_LOG_WAKE         3       //!< Wake from deep sleep
+#define DS1302_LOG_MAX_CODE     7       //!< Highest user defined code
+
+//! Maximum number of events which fit into the RAM
+#define DS1302_LOG_MAX_EVENTS   16
+
+/*!
+ * \brief Log event
+ */
+typedef struct {
+    uint8_t code;       //!< Event code 1..7
+    uint32_t epoch;     //!< Seconds since 2000-01-01 00:00:00
+} DS1302_LogEvent;
+
+void DS1302_logFormat(DS1302_Dev *dev);
+bool DS1302_logAppend(DS1302_Dev *dev, uint8_t code, uint32_t epoch);
+int DS1302_logRead(DS1302_Dev *dev, DS1302_LogEvent *events, int maxEvents);
+
+#endif // MAIN_DS1302_LOG_H_
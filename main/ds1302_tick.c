@@ -0,0 +1,480 @@
+/*
+ * Seconds tick service.
+ *
+ * The rollover is first found to a FreeRTOS tick by polling the seconds
+ * register once per tick. One second later the register is polled without
+ * delay around the next rollover, which finds it to some 40us.
+ * From then on the boundaries are predicted with esp_timer.
+ *
+ * Every verifyEvery ticks the seconds register is polled for a few
+ * milliseconds around a predicted boundary. The measured phase error is
+ * added to the next prediction and rollovers some seconds apart give the
+ * period of the RTC crystal, so crystal drift is tracked while the timer
+ * keeps running. When the rollover is outside the polled window, the
+ * prediction is stepped towards it and checked again at the next boundary.
+ * The step doubles until the rollover is passed and then halves at each
+ * check, a bisection.
+ * Only when the register does not hold the predicted second does the
+ * service lock onto the rollover again.
+ * All reads use microsecond bit timing.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "ds1302_tick.h"
+
+#define TAG "DS1302_TICK"
+
+//! Stack size of the verification task [bytes]
+#ifdef CONFIG_TICK_VERIFY_STACK_SIZE
+#define DS1302_TICK_STACK_SIZE      CONFIG_TICK_VERIFY_STACK_SIZE
+#elif CONFIG_DS1302_MINIMAL_FOOTPRINT
+#define DS1302_TICK_STACK_SIZE      1536
+#else
+#define DS1302_TICK_STACK_SIZE      3072
+#endif
+
+//! Longest time to wait for a rollover while locking [us]
+#define DS1302_TICK_LOCK_TIMEOUT    2500000
+
+//! Half width of the window polled around a predicted boundary [us]
+#define DS1302_TICK_MARGIN          2000
+
+//! Largest step towards a rollover outside the window [us]
+#define DS1302_TICK_MAX_STEP        250000
+
+//! Time the verification task is woken before the window [us]
+#define DS1302_TICK_WAKE_LEAD       500
+
+//! Fewest ticks between two rollovers used for the period
+#define DS1302_TICK_MIN_SPAN        16
+
+//! Largest period error accepted [us per second]
+#define DS1302_TICK_MAX_DRIFT       500
+
+//! One FreeRTOS tick [us]
+#define DS1302_TICK_PERIOD          (portTICK_PERIOD_MS * 1000)
+
+typedef enum {
+    DS1302_TICK_FOUND = 0,      //!< Rollover inside the window
+    DS1302_TICK_EARLY,          //!< Rollover before the window
+    DS1302_TICK_LATE,           //!< Rollover after the window
+    DS1302_TICK_LOST,           //!< Register does not hold the predicted second
+} DS1302_TickPhase;
+
+typedef struct {
+    DS1302_TickCallback callback;
+    void *arg;
+} DS1302_TickSubscriber;
+
+static struct {
+    DS1302_Dev *dev;
+    esp_timer_handle_t timer;
+    esp_timer_handle_t wakeTimer;
+    TaskHandle_t verifyTask;
+    int64_t nextUs;             //!< Predicted time of the next boundary
+    int32_t periodQ8;           //!< Predicted period [us/256]
+    uint32_t fracQ8;            //!< Fraction of a microsecond carried to the next boundary [us/256]
+    int32_t correctionUs;       //!< Phase correction for the next prediction
+    uint32_t ticks;             //!< Boundaries since the lock
+    int64_t verifyUs;           //!< Boundary to check
+    uint32_t verifyTick;        //!< Index of the boundary to check
+    uint8_t verifySecond;       //!< Second before the boundary to check
+    bool resync;                //!< Check the next boundary
+    int64_t refUs;              //!< Rollover used as reference for the period
+    uint32_t refTick;           //!< Index of the reference rollover
+    int32_t stepUs;             //!< Step towards a rollover outside the window
+    int8_t stepDir;             //!< Direction of the last step
+    bool bracketed;             //!< Rollover passed, the step only halves
+    uint16_t verifyEvery;
+    uint16_t count;
+    uint8_t second;             //!< Second which started at the last boundary
+    uint8_t numSubscribers;
+    DS1302_TickSubscriber subscribers[DS1302_TICK_MAX_SUBSCRIBERS];
+} tick;
+
+/*!
+ * \brief Start a one-shot timer at an esp_timer time
+ */
+static void DS1302_tickArm(esp_timer_handle_t timer, int64_t time)
+{
+    int64_t delay = time - esp_timer_get_time();
+
+    esp_timer_start_once(timer, (delay > 0) ? (uint64_t)delay : 0);
+}
+
+/*!
+ * \brief Read the raw seconds register
+ */
+static uint8_t DS1302_tickRead(void)
+{
+    return DS1302_readClockRegisterFast(tick.dev, DS1302_REG_SECONDS);
+}
+
+/*!
+ * \brief Sleep until shortly before a time and busy-wait the rest
+ * \param time
+ *      esp_timer time [us]
+ * \note
+ *      Busy-waits for one to two FreeRTOS ticks. Only used while locking.
+ */
+static void DS1302_tickSleepUntil(int64_t time)
+{
+    int64_t delay = time - esp_timer_get_time();
+
+    if (delay > 2 * DS1302_TICK_PERIOD) {
+        vTaskDelay((TickType_t)(delay / DS1302_TICK_PERIOD - 1));
+    }
+    while (esp_timer_get_time() < time) {
+    }
+}
+
+/*!
+ * \brief Lock onto the seconds rollover
+ * \return
+ *      true:  Locked, timer armed
+ *      false: RTC halted or seconds register does not change
+ * \note
+ *      Busy-waits for up to two FreeRTOS ticks around the rollover.
+ */
+static bool DS1302_tickLock(void)
+{
+    uint8_t first;
+    uint8_t reg;
+    int64_t coarse;
+    int64_t before;
+    int64_t after;
+    int64_t timeout;
+
+    first = DS1302_tickRead();
+    if (first & (1 << DS1302_BIT_CH)) {
+        return false;
+    }
+
+    // Coarse: one read per FreeRTOS tick
+    timeout = esp_timer_get_time() + DS1302_TICK_LOCK_TIMEOUT;
+    do {
+        vTaskDelay(1);
+        reg = DS1302_tickRead();
+        coarse = esp_timer_get_time();
+    } while ((reg == first) && (coarse < timeout));
+
+    if (reg == first) {
+        return false;
+    }
+
+    // Fine: the next rollover is one second later, poll without delay around it.
+    // It took place between the previous and the current sample, take the midpoint.
+    DS1302_tickSleepUntil(coarse + 1000000 - 2 * DS1302_TICK_PERIOD);
+    first = reg;
+    after = esp_timer_get_time();
+    timeout = coarse + 1000000 + DS1302_TICK_MARGIN;
+    do {
+        before = after;
+        reg = DS1302_tickRead();
+        after = esp_timer_get_time();
+    } while ((reg == first) && (after < timeout));
+
+    if (reg == first) {
+        return false;
+    }
+
+    tick.second = bcdToDec(reg & 0x7F);
+    tick.refUs = before + (after - before) / 2;
+    tick.refTick = tick.ticks;
+    tick.nextUs = tick.refUs + (tick.periodQ8 >> 8);
+    tick.fracQ8 = 0;
+    tick.correctionUs = 0;
+    tick.count = 0;
+    tick.resync = false;
+    tick.stepUs = DS1302_TICK_MARGIN;
+    tick.stepDir = 0;
+    tick.bracketed = false;
+    DS1302_DEBUG(TAG, "locked second=%d window=%dus", tick.second, (int)(after - before));
+    DS1302_tickArm(tick.timer, tick.nextUs);
+
+    return true;
+}
+
+/*!
+ * \brief Timer callback at each predicted boundary
+ */
+static void DS1302_tickHandler(void *arg)
+{
+    tick.second = (tick.second + 1) % 60;
+    tick.ticks++;
+    tick.fracQ8 += tick.periodQ8;
+    tick.nextUs += (tick.fracQ8 >> 8) + tick.correctionUs;
+    tick.fracQ8 &= 0xFF;
+    tick.correctionUs = 0;
+    DS1302_tickArm(tick.timer, tick.nextUs);
+
+    for (uint8_t i = 0; i < tick.numSubscribers; i++) {
+        tick.subscribers[i].callback(tick.second, tick.subscribers[i].arg);
+    }
+
+    if (tick.verifyEvery && (tick.resync || (++tick.count >= tick.verifyEvery))) {
+        tick.count = 0;
+        tick.resync = false;
+        tick.verifyUs = tick.nextUs;
+        tick.verifyTick = tick.ticks + 1;
+        tick.verifySecond = tick.second;
+        DS1302_tickArm(tick.wakeTimer, tick.nextUs - DS1302_TICK_MARGIN - DS1302_TICK_WAKE_LEAD);
+    }
+}
+
+/*!
+ * \brief Wake the verification task shortly before the window
+ */
+static void DS1302_tickWake(void *arg)
+{
+    xTaskNotifyGive(tick.verifyTask);
+}
+
+/*!
+ * \brief Poll the seconds register around a predicted boundary
+ * \param boundary
+ *      Predicted boundary, esp_timer time [us]
+ * \param expected
+ *      Second before the boundary
+ * \param rollover
+ *      Time of the rollover when it is inside the window
+ */
+static DS1302_TickPhase DS1302_tickMeasure(int64_t boundary, uint8_t expected, int64_t *rollover)
+{
+    uint8_t next = (expected + 1) % 60;
+    uint8_t second;
+    int64_t before;
+    int64_t after;
+
+    while (esp_timer_get_time() < boundary - DS1302_TICK_MARGIN) {
+    }
+
+    second = bcdToDec(DS1302_tickRead() & 0x7F);
+    after = esp_timer_get_time();
+    if (second == next) {
+        return DS1302_TICK_EARLY;
+    }
+    if (second != expected) {
+        return DS1302_TICK_LOST;
+    }
+
+    while (after < boundary + DS1302_TICK_MARGIN) {
+        before = after;
+        second = bcdToDec(DS1302_tickRead() & 0x7F);
+        after = esp_timer_get_time();
+        if (second != expected) {
+            if (second != next) {
+                return DS1302_TICK_LOST;
+            }
+            *rollover = before + (after - before) / 2;
+            return DS1302_TICK_FOUND;
+        }
+    }
+
+    return DS1302_TICK_LATE;
+}
+
+/*!
+ * \brief Step the prediction towards a rollover outside the window
+ * \param dir
+ *      1: rollover is later, -1: rollover is earlier
+ */
+static void DS1302_tickStep(int8_t dir)
+{
+    if (tick.stepDir && (tick.stepDir != dir)) {
+        tick.bracketed = true;
+    }
+    if (tick.bracketed) {
+        tick.stepUs = (tick.stepUs / 2 > DS1302_TICK_MARGIN) ? tick.stepUs / 2 : DS1302_TICK_MARGIN;
+    } else if (tick.stepDir) {
+        tick.stepUs = (tick.stepUs * 2 < DS1302_TICK_MAX_STEP) ? tick.stepUs * 2 : DS1302_TICK_MAX_STEP;
+    }
+    tick.stepDir = dir;
+    tick.correctionUs = dir * tick.stepUs;
+    tick.resync = true;
+}
+
+/*!
+ * \brief Correct the phase and the period of the prediction
+ * \param index
+ *      Index of the measured boundary
+ * \param rollover
+ *      Measured rollover, esp_timer time [us]
+ * \param error
+ *      Measured rollover minus predicted boundary [us]
+ */
+static void DS1302_tickCorrect(uint32_t index, int64_t rollover, int32_t error)
+{
+    int32_t period;
+    int32_t limit;
+
+    if (index - tick.refTick >= DS1302_TICK_MIN_SPAN) {
+        period = (int32_t)(((rollover - tick.refUs) * 256) / (int32_t)(index - tick.refTick));
+        limit = DS1302_TICK_MAX_DRIFT * 256;
+        if ((period > 1000000 * 256 - limit) && (period < 1000000 * 256 + limit)) {
+            tick.periodQ8 += (period - tick.periodQ8) / 4;
+        }
+        tick.refUs = rollover;
+        tick.refTick = index;
+    }
+
+    tick.correctionUs = error;
+    tick.stepUs = DS1302_TICK_MARGIN;
+    tick.stepDir = 0;
+    tick.bracketed = false;
+    DS1302_DEBUG(TAG, "phase error=%dus period=%dus", (int)error, (int)(tick.periodQ8 >> 8));
+}
+
+/*!
+ * \brief Check the prediction against the seconds register
+ * \note
+ *      Called shortly before the window, busy-waits for DS1302_TICK_WAKE_LEAD
+ *      and polls the register for 2 * DS1302_TICK_MARGIN at most.
+ */
+static void DS1302_tickCheck(void)
+{
+    int64_t boundary = tick.verifyUs;
+    uint32_t index = tick.verifyTick;
+    uint8_t expected = tick.verifySecond;
+    int64_t rollover;
+
+    if (esp_timer_get_time() > boundary - DS1302_TICK_MARGIN) {
+        tick.resync = true; // Woken too late for this boundary, check the next one
+        return;
+    }
+
+    switch (DS1302_tickMeasure(boundary, expected, &rollover)) {
+    case DS1302_TICK_FOUND:
+        DS1302_tickCorrect(index, rollover, (int32_t)(rollover - boundary));
+        break;
+    case DS1302_TICK_EARLY:
+        DS1302_tickStep(-1);
+        break;
+    case DS1302_TICK_LATE:
+        DS1302_tickStep(1);
+        break;
+    default:
+        DS1302_WARN(TAG, "phase lost, predicted=%d", expected);
+        esp_timer_stop(tick.timer);
+        esp_timer_stop(tick.wakeTimer);
+        while (!DS1302_tickLock()) {
+            vTaskDelay(1000 / portTICK_PERIOD_MS);
+        }
+        break;
+    }
+}
+
+/*!
+ * \brief Verification task, woken by the wake timer
+ */
+static void DS1302_tickVerify(void *pvParameters)
+{
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        DS1302_tickCheck();
+    }
+}
+
+/*!
+ * \brief Start the tick service
+ * \param dev
+ *      Initialized DS1302 device
+ * \param verifyEvery
+ *      Check the prediction every verifyEvery ticks (0: never)
+ * \return
+ *      true:  Service running
+ *      false: RTC halted or service could not be started
+ * \note
+ *      The verification task uses the bus. Do not access the DS1302
+ *      from other tasks while the service is running with verifyEvery > 0.
+ */
+bool DS1302_tickBegin(DS1302_Dev *dev, uint16_t verifyEvery)
+{
+    const esp_timer_create_args_t timerArgs = {
+        .callback = DS1302_tickHandler,
+        .name = "ds1302tick",
+    };
+    const esp_timer_create_args_t wakeArgs = {
+        .callback = DS1302_tickWake,
+        .name = "ds1302wake",
+    };
+
+    tick.dev = dev;
+    tick.verifyEvery = verifyEvery;
+    tick.periodQ8 = 1000000 * 256;
+
+    if (esp_timer_create(&timerArgs, &tick.timer) != ESP_OK) {
+        tick.timer = NULL;
+        return false;
+    }
+
+    if (verifyEvery) {
+        if (esp_timer_create(&wakeArgs, &tick.wakeTimer) != ESP_OK) {
+            tick.wakeTimer = NULL;
+            DS1302_tickEnd();
+            return false;
+        }
+        if (xTaskCreate(DS1302_tickVerify, "ds1302tick", DS1302_TICK_STACK_SIZE, NULL,
+                        uxTaskPriorityGet(NULL), &tick.verifyTask) != pdPASS) {
+            tick.verifyTask = NULL;
+            DS1302_tickEnd();
+            return false;
+        }
+    }
+
+    if (!DS1302_tickLock()) {
+        DS1302_tickEnd();
+        return false;
+    }
+
+    return true;
+}
+
+/*!
+ * \brief Add a tick subscriber
+ * \param callback
+ *      Function called at each second boundary
+ * \param arg
+ *      Argument passed to the callback
+ * \return
+ *      true:  Subscribed
+ *      false: Too many subscribers
+ */
+bool DS1302_tickSubscribe(DS1302_TickCallback callback, void *arg)
+{
+    if (tick.numSubscribers >= DS1302_TICK_MAX_SUBSCRIBERS) {
+        return false;
+    }
+
+    tick.subscribers[tick.numSubscribers].arg = arg;
+    tick.subscribers[tick.numSubscribers].callback = callback;
+    tick.numSubscribers++;
+
+    return true;
+}
+
+/*!
+ * \brief Stop the tick service and remove all subscribers
+ */
+void DS1302_tickEnd(void)
+{
+    if (tick.verifyTask) {
+        vTaskDelete(tick.verifyTask);
+    }
+    if (tick.wakeTimer) {
+        esp_timer_stop(tick.wakeTimer);
+        esp_timer_delete(tick.wakeTimer);
+    }
+    if (tick.timer) {
+        esp_timer_stop(tick.timer);
+        esp_timer_delete(tick.timer);
+    }
+    memset(&tick, 0x00, sizeof(tick));
+}
@@ -0,0 +1,33 @@
+/*
+ * Seconds tick service.
+ * Locks onto the DS1302 seconds rollover once and then fires the
+ * subscribers at each predicted second boundary using esp_timer.
+ */
+
+#ifndef MAIN_DS1302_TICK_H_
+#define MAIN_DS1302_TICK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ds1302.h"
+
+//! Maximum number of tick subscribers
+#define DS1302_TICK_MAX_SUBSCRIBERS 4
+
+/*!
+ * \brief Tick callback
+ * \param second
+ *      Second 0..59 which has just started
+ * \param arg
+ *      Argument given to DS1302_tickSubscribe()
+ * \note
+ *      Called from the esp_timer task. Do not access the DS1302 bus here.
+ */
+typedef void (*DS1302_TickCallback)(uint8_t second, void *arg);
+
+bool DS1302_tickBegin(DS1302_Dev *dev, uint16_t verifyEvery);
+bool DS1302_tickSubscribe(DS1302_TickCallback callback, void *arg);
+void DS1302_tickEnd(void);
+
+#endif // MAIN_DS1302_TICK_H_
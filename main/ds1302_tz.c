@@ -0,0 +1,200 @@
+/*
+ * Timezone and DST rule engine.
+ *
+ * Times are seconds since 2000-01-01 00:00:00 as used by
+ * DS1302_dateTimeToEpoch(). The DST transitions of the last year
+ * used are cached, so a conversion is a few integer operations.
+ */
+
+#include <stdio.h>
+
+#include "sdkconfig.h"
+
+#include "ds1302_tz.h"
+
+static const DS1302_TzRule rule =
+#if CONFIG_TZ_FIXED
+    { "Fixed", CONFIG_TIMEZONE * 60, CONFIG_TIMEZONE * 60, { 0 }, { 0 } };
+#elif CONFIG_TZ_US_EASTERN
+    { "US Eastern", -300, -240, { 3, 2, 0, 120 }, { 11, 1, 0, 120 } };
+#elif CONFIG_TZ_US_CENTRAL
+    { "US Central", -360, -300, { 3, 2, 0, 120 }, { 11, 1, 0, 120 } };
+#elif CONFIG_TZ_US_MOUNTAIN
+    { "US Mountain", -420, -360, { 3, 2, 0, 120 }, { 11, 1, 0, 120 } };
+#elif CONFIG_TZ_US_PACIFIC
+    { "US Pacific", -480, -420, { 3, 2, 0, 120 }, { 11, 1, 0, 120 } };
+#elif CONFIG_TZ_EU_WESTERN
+    { "EU Western", 0, 60, { 3, 5, 0, 60 }, { 10, 5, 0, 120 } };
+#elif CONFIG_TZ_EU_CENTRAL
+    { "EU Central", 60, 120, { 3, 5, 0, 120 }, { 10, 5, 0, 180 } };
+#elif CONFIG_TZ_EU_EASTERN
+    { "EU Eastern", 120, 180, { 3, 5, 0, 180 }, { 10, 5, 0, 240 } };
+#elif CONFIG_TZ_JAPAN
+    { "Japan", 540, 540, { 0 }, { 0 } };
+#elif CONFIG_TZ_AU_EASTERN
+    { "AU Eastern", 600, 660, { 10, 1, 0, 120 }, { 4, 1, 0, 180 } };
+#elif CONFIG_TZ_NEW_ZEALAND
+    { "New Zealand", 720, 780, { 9, 5, 0, 120 }, { 4, 1, 0, 180 } };
+#else
+    { "UTC", 0, 0, { 0 }, { 0 } };
+#endif
+
+static struct {
+    uint16_t year;
+    uint32_t start;     //!< UTC start of DST
+    uint32_t end;       //!< UTC end of DST
+} cache;
+
+static uint8_t daysInMonth(uint16_t year, uint8_t month)
+{
+    static const uint8_t days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    if ((month == 2) && ((year % 4) == 0)) {
+        return 29; // 2000..2099
+    }
+    return days[month - 1];
+}
+
+/*!
+ * \brief Local time of a transition
+ * \param year
+ *      Year 2000..2099
+ * \param t
+ *      Transition
+ * \return
+ *      Local epoch of the transition
+ */
+static uint32_t transitionTime(uint16_t year, const DS1302_TzTransition *t)
+{
+    DS1302_DateTime dt = { 0 };
+    uint32_t first;
+    uint8_t day;
+
+    dt.year = year;
+    dt.month = t->month;
+    dt.dayMonth = 1;
+    first = DS1302_dateTimeToEpoch(&dt) / 86400;
+
+    // 2000-01-01 was a Saturday
+    day = 1 + (t->dayWeek + 7 - (first + 6) % 7) % 7 + 7 * (t->week - 1);
+    if (day > daysInMonth(year, t->month)) {
+        day -= 7;
+    }
+
+    return (first + day - 1) * 86400 + t->minute * 60;
+}
+
+/*!
+ * \brief Add an offset to an epoch
+ * \param time
+ *      Seconds since 2000-01-01 00:00:00
+ * \param offset
+ *      Offset in minutes
+ * \return
+ *      Shifted epoch, 0 when it would be before 2000-01-01 00:00:00
+ */
+static uint32_t shiftTime(uint32_t time, int16_t offset)
+{
+    int64_t shifted = (int64_t)time + offset * 60;
+
+    return (shifted < 0) ? 0 : (uint32_t)shifted;
+}
+
+/*!
+ * \brief Get the selected timezone rule
+ */
+const DS1302_TzRule *DS1302_tzRule(void)
+{
+    return &rule;
+}
+
+/*!
+ * \brief Check daylight saving time
+ * \param utc
+ *      UTC seconds since 2000-01-01 00:00:00
+ * \return
+ *      true: DST in effect
+ */
+bool DS1302_tzIsDst(uint32_t utc)
+{
+    DS1302_DateTime dt;
+
+    if (rule.start.month == 0) {
+        return false;
+    }
+
+    DS1302_epochToDateTime(utc, &dt);
+    if (cache.year != dt.year) {
+        cache.year = dt.year;
+        cache.start = transitionTime(dt.year, &rule.start) - rule.stdOffset * 60;
+        cache.end = transitionTime(dt.year, &rule.end) - rule.dstOffset * 60;
+    }
+
+    if (cache.start < cache.end) {
+        return (utc >= cache.start) && (utc < cache.end);
+    } else {
+        // Southern hemisphere, DST spans the new year
+        return (utc >= cache.start) || (utc < cache.end);
+    }
+}
+
+/*!
+ * \brief UTC to local time
+ * \param utc
+ *      UTC seconds since 2000-01-01 00:00:00
+ * \return
+ *      Local seconds since 2000-01-01 00:00:00
+ * \note
+ *      Times west of UTC before 2000-01-01 00:00:00 local are clamped to 0.
+ */
+uint32_t DS1302_tzUtcToLocal(uint32_t utc)
+{
+    int16_t offset = DS1302_tzIsDst(utc) ? rule.dstOffset : rule.stdOffset;
+
+    return shiftTime(utc, offset);
+}
+
+/*!
+ * \brief Local time to UTC
+ * \param local
+ *      Local seconds since 2000-01-01 00:00:00
+ * \return
+ *      UTC seconds since 2000-01-01 00:00:00
+ * \note
+ *      A time repeated at the end of DST is taken as DST.
+ *      A time skipped at the start of DST is moved forward by the DST shift.
+ *      Times east of UTC before 2000-01-01 00:00:00 UTC are clamped to 0.
+ */
+uint32_t DS1302_tzLocalToUtc(uint32_t local)
+{
+    uint32_t utc = shiftTime(local, -rule.dstOffset);
+
+    if (DS1302_tzIsDst(utc)) {
+        return utc;
+    }
+    return shiftTime(local, -rule.stdOffset);
+}
+
+/*!
+ * \brief UTC to local date and time
+ * \param utc
+ *      UTC date and time
+ * \param local
+ *      Local date and time
+ */
+void DS1302_tzToLocal(const DS1302_DateTime *utc, DS1302_DateTime *local)
+{
+    DS1302_epochToDateTime(DS1302_tzUtcToLocal(DS1302_dateTimeToEpoch(utc)), local);
+}
+
+/*!
+ * \brief Local date and time to UTC
+ * \param local
+ *      Local date and time
+ * \param utc
+ *      UTC date and time
+ */
+void DS1302_tzToUtc(const DS1302_DateTime *local, DS1302_DateTime *utc)
+{
+    DS1302_epochToDateTime(DS1302_tzLocalToUtc(DS1302_dateTimeToEpoch(local)), utc);
+}
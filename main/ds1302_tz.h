@@ -0,0 +1,43 @@
+/*
+ * Timezone and DST rule engine.
+ * The rule is selected with menuconfig and compiled into constant data.
+ * The RTC is kept in UTC.
+ */
+
+#ifndef MAIN_DS1302_TZ_H_
+#define MAIN_DS1302_TZ_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ds1302.h"
+
+/*!
+ * \brief DST transition, same meaning as Mm.w.d/time of a POSIX TZ string
+ */
+typedef struct {
+    uint8_t month;      //!< Month 1..12 (0 as no DST)
+    uint8_t week;       //!< Week of the month 1..4 (5 as last)
+    uint8_t dayWeek;    //!< Day of the week (0 as Sunday)
+    int16_t minute;     //!< Local wall clock time in minutes after midnight
+} DS1302_TzTransition;
+
+/*!
+ * \brief Timezone rule
+ */
+typedef struct {
+    const char *name;           //!< Zone name
+    int16_t stdOffset;          //!< Standard time offset in minutes east of UTC
+    int16_t dstOffset;          //!< Daylight saving time offset in minutes east of UTC
+    DS1302_TzTransition start;  //!< Start of DST (in standard time)
+    DS1302_TzTransition end;    //!< End of DST (in daylight saving time)
+} DS1302_TzRule;
+
+const DS1302_TzRule *DS1302_tzRule(void);
+bool DS1302_tzIsDst(uint32_t utc);
+uint32_t DS1302_tzUtcToLocal(uint32_t utc);
+uint32_t DS1302_tzLocalToUtc(uint32_t local);
+void DS1302_tzToLocal(const DS1302_DateTime *utc, DS1302_DateTime *local);
+void DS1302_tzToUtc(const DS1302_DateTime *local, DS1302_DateTime *utc);
+
+#endif // MAIN_DS1302_TZ_H_
@@ -14,6 +14,10 @@
 #include "esp_sntp.h"
 
 #include "ds1302.h"
+#include "ds1302_tick.h"
+#include "ds1302_tz.h"
+#include "ds1302_log.h"
+#include "ds1302_cache.h"
 
 #if CONFIG_SET_CLOCK
 	#define NTP_SERVER CONFIG_NTP_SERVER
@@ -24,6 +28,9 @@
 #if CONFIG_DIFF_CLOCK
 	#define NTP_SERVER CONFIG_NTP_SERVER
 #endif
+#if CONFIG_STACK_PROFILE
+	#define NTP_SERVER " "
+#endif
 
 static const char *TAG = "DS1302";
 
@@ -87,16 +94,15 @@ void setClock(void *pvParameters)
 	struct tm timeinfo;
 	char strftime_buf[64];
 	time(&now);
-	now = now + (CONFIG_TIMEZONE*60*60);
-	localtime_r(&now, &timeinfo);
+	gmtime_r(&now, &timeinfo);
 	strftime(strftime_buf, sizeof(strftime_buf), "%c", &timeinfo);
-	ESP_LOGI(pcTaskGetName(0), "The current date/time is: %s", strftime_buf);
+	ESP_LOGI(pcTaskGetName(0), "The current UTC date/time is: %s", strftime_buf);
 
 
 	// Initialize RTC
 	DS1302_Dev dev;
 	if (!DS1302_begin(&dev, CONFIG_CLK_GPIO, CONFIG_IO_GPIO, CONFIG_CE_GPIO)) {
-		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin");
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin link=%d", dev.link);
 		while (1) { vTaskDelay(1); }
 	}
 	ESP_LOGI(pcTaskGetName(0), "Set initial date time...");
@@ -121,17 +127,23 @@ void setClock(void *pvParameters)
 	ESP_LOGD(pcTaskGetName(0), "timeinfo.tm_mon=%d",timeinfo.tm_mon);
 	ESP_LOGD(pcTaskGetName(0), "timeinfo.tm_year=%d",timeinfo.tm_year);
 
-	// Set initial date and time
+	// Set initial date and time in UTC
 	DS1302_DateTime dt;
 	dt.second = timeinfo.tm_sec;
 	dt.minute = timeinfo.tm_min;
 	dt.hour = timeinfo.tm_hour;
-	dt.dayWeek = timeinfo.tm_wday; // 0= Sunday 1 = Monday
+	dt.dayWeek = (timeinfo.tm_wday == 0) ? 7 : timeinfo.tm_wday; // 1 = Monday 7 = Sunday
 	dt.dayMonth = timeinfo.tm_mday;
 	dt.month = (timeinfo.tm_mon + 1);
 	dt.year = (timeinfo.tm_year + 1900);
 	DS1302_setDateTime(&dev, &dt);
 
+	DS1302_DateTime local;
+	DS1302_tzToLocal(&dt, &local);
+	ESP_LOGI(pcTaskGetName(0), "The current local date/time is: %d %02d-%02d-%d %d:%02d:%02d (%s)",
+		local.dayWeek, local.dayMonth, local.month, local.year, local.hour, local.minute, local.second,
+		DS1302_tzRule()->name);
+
 	// Check write protect state
 	if (DS1302_isWriteProtected(&dev)) {
 		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 write protected");
@@ -151,6 +163,11 @@ void setClock(void *pvParameters)
 	esp_deep_sleep(1000000LL * deep_sleep_sec);
 }
 
+static void tick_notification_cb(uint8_t second, void *arg)
+{
+	xTaskNotify((TaskHandle_t)arg, second, eSetValueWithOverwrite);
+}
+
 void getClock(void *pvParameters)
 {
 	DS1302_Dev dev;
@@ -159,21 +176,36 @@ void getClock(void *pvParameters)
 	// Initialize RTC
 	ESP_LOGI(pcTaskGetName(0), "Start");
 	if (!DS1302_begin(&dev, CONFIG_CLK_GPIO, CONFIG_IO_GPIO, CONFIG_CE_GPIO)) {
-		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin");
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin link=%d", dev.link);
 		while (1) { vTaskDelay(1); }
 	}
 
-	// Initialise the xLastWakeTime variable with the current time.
-	TickType_t xLastWakeTime = xTaskGetTickCount();
+	// Get RTC date and time once
+	if (!DS1302_getDateTime(&dev, &dt)) {
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 read failed");
+		while (1) { vTaskDelay(1); }
+	}
+	uint32_t epoch = DS1302_dateTimeToEpoch(&dt);
+
+	// Lock onto the RTC seconds rollover
+	// From now on only the tick service accesses the bus
+	if (!DS1302_tickBegin(&dev, CONFIG_TICK_VERIFY_INTERVAL)) {
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 tick begin");
+		while (1) { vTaskDelay(1); }
+	}
+	DS1302_tickSubscribe(tick_notification_cb, xTaskGetCurrentTaskHandle());
+
 	while(1) {
-		// Get RTC date and time
-		if (!DS1302_getDateTime(&dev, &dt)) {
-			ESP_LOGE(pcTaskGetName(0), "Error: DS1302 read failed");
-		} else {
-			ESP_LOGI(pcTaskGetName(0), "%d %02d-%02d-%d %d:%02d:%02d",
-				 dt.dayWeek, dt.dayMonth, dt.month, dt.year, dt.hour, dt.minute, dt.second);
-		}
-		vTaskDelayUntil(&xLastWakeTime, 1000);
+		uint32_t second;
+		xTaskNotifyWait(0, 0, &second, portMAX_DELAY);
+
+		// Advance the date and time to the second given by the RTC
+		uint32_t next = epoch + 1 - ((epoch + 1) % 60) + second;
+		if (next + 30 < epoch) next = next + 60;
+		epoch = next;
+		DS1302_epochToDateTime(DS1302_tzUtcToLocal(epoch), &dt);
+		ESP_LOGI(pcTaskGetName(0), "%d %02d-%02d-%d %d:%02d:%02d",
+			 dt.dayWeek, dt.dayMonth, dt.month, dt.year, dt.hour, dt.minute, dt.second);
 	}
 }
 
@@ -191,17 +223,16 @@ void diffClock(void *pvParameters)
 	struct tm timeinfo;
 	char strftime_buf[64];
 	time(&now);
-	now = now + (CONFIG_TIMEZONE*60*60);
-	localtime_r(&now, &timeinfo);
+	gmtime_r(&now, &timeinfo);
 	strftime(strftime_buf, sizeof(strftime_buf), "%m-%d-%y %H:%M:%S", &timeinfo);
-	ESP_LOGI(pcTaskGetName(0), "NTP date/time is: %s", strftime_buf);
+	ESP_LOGI(pcTaskGetName(0), "NTP UTC date/time is: %s", strftime_buf);
 
 	DS1302_Dev dev;
 	DS1302_DateTime dt;
 
 	// Initialize RTC
 	if (!DS1302_begin(&dev, CONFIG_CLK_GPIO, CONFIG_IO_GPIO, CONFIG_CE_GPIO)) {
-		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin");
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin link=%d", dev.link);
 		while (1) { vTaskDelay(1); }
 	}
 
@@ -212,18 +243,17 @@ void diffClock(void *pvParameters)
 	}
 
 	// update 'rtcnow' variable with current time
-	struct tm rtcinfo;
-	rtcinfo.tm_sec = dt.second;
-	rtcinfo.tm_min = dt.minute;
-	rtcinfo.tm_hour = dt.hour;
-	rtcinfo.tm_mday = dt.dayMonth;
-	rtcinfo.tm_mon = dt.month - 1; // 0 org.
-	rtcinfo.tm_year = dt.year - 1900;
-	rtcinfo.tm_isdst = -1;
-	time_t rtcnow = mktime(&rtcinfo);
-	localtime_r(&rtcnow, &timeinfo);
+	// The RTC keeps UTC. 946684800 is 2000-01-01 00:00:00 in UNIX time.
+	time_t rtcnow = (time_t)DS1302_dateTimeToEpoch(&dt) + 946684800;
+	gmtime_r(&rtcnow, &timeinfo);
 	strftime(strftime_buf, sizeof(strftime_buf), "%m-%d-%y %H:%M:%S", &timeinfo);
-	ESP_LOGI(pcTaskGetName(0), "RTC date/time is: %s", strftime_buf);
+	ESP_LOGI(pcTaskGetName(0), "RTC UTC date/time is: %s", strftime_buf);
+
+	DS1302_DateTime local;
+	DS1302_tzToLocal(&dt, &local);
+	ESP_LOGI(pcTaskGetName(0), "RTC local date/time is: %02d-%02d-%02d %02d:%02d:%02d (%s)",
+		local.month, local.dayMonth, local.year % 100, local.hour, local.minute, local.second,
+		DS1302_tzRule()->name);
 
 	// Get the time difference
 	double x = difftime(rtcnow, now);
@@ -234,6 +264,133 @@ void diffClock(void *pvParameters)
 	}
 }
 
+#if CONFIG_STACK_PROFILE
+// Each API runs in a fresh task, so the high-water mark of that task is the worst case of the API
+#define PROBE_STACK_SIZE 2048
+
+static DS1302_Dev probe_dev;
+static TaskHandle_t probe_parent;
+
+static void probe_getDateTime(void) { DS1302_DateTime dt; DS1302_getDateTime(&probe_dev, &dt); }
+static void probe_getFields(void) { DS1302_DateTime dt; DS1302_getFields(&probe_dev, DS1302_FIELD_DATE, &dt); }
+static void probe_getTime(void) { uint8_t h, m, s; DS1302_getTime(&probe_dev, &h, &m, &s); }
+static void probe_isHalted(void) { DS1302_isHalted(&probe_dev); }
+static void probe_isWriteProtected(void) { DS1302_isWriteProtected(&probe_dev); }
+static void probe_readClockRegister(void) { DS1302_readClockRegister(&probe_dev, DS1302_REG_TC); }
+static void probe_readByteRAM(void) { DS1302_readByteRAM(&probe_dev, 0); }
+static void probe_writeByteRAM(void) { DS1302_writeByteRAM(&probe_dev, 0, DS1302_readByteRAM(&probe_dev, 0)); }
+static void probe_readBufferRAM(void) { uint8_t buf[NUM_DS1302_RAM_REGS]; DS1302_readBufferRAM(&probe_dev, buf, sizeof(buf)); }
+static void probe_snapshot(void) { DS1302_Snapshot snapshot; DS1302_snapshot(&probe_dev, &snapshot); }
+static void probe_linkProbe(void) { DS1302_linkProbe(&probe_dev); }
+static void probe_linkCheck(void) { DS1302_linkCheck(&probe_dev); }
+static void probe_logRead(void) { DS1302_LogEvent events[4]; DS1302_logRead(&probe_dev, events, 4); }
+static void probe_tzToLocal(void) { DS1302_DateTime utc = { 0, 0, 0, 6, 1, 1, 2000 }, local; DS1302_tzToLocal(&utc, &local); }
+
+// Write probes write back what they read, the clock may lose the few milliseconds of the probe
+static DS1302_Cache probe_cache;
+static uint8_t probe_ram[NUM_DS1302_RAM_REGS];
+
+static void probe_setDateTime(void) { DS1302_DateTime dt; if (DS1302_getDateTime(&probe_dev, &dt)) DS1302_setDateTime(&probe_dev, &dt); }
+static void probe_setFields(void) { DS1302_DateTime dt; if (DS1302_getFields(&probe_dev, DS1302_FIELD_DATE, &dt)) DS1302_setFields(&probe_dev, DS1302_FIELD_DATE, &dt); }
+static void probe_setTime(void) { uint8_t h, m, s; if (DS1302_getTime(&probe_dev, &h, &m, &s)) DS1302_setTime(&probe_dev, h, m, s); }
+static void probe_halt(void) { DS1302_halt(&probe_dev, DS1302_isHalted(&probe_dev)); }
+static void probe_writeBufferRAM(void) { uint8_t buf[NUM_DS1302_RAM_REGS]; DS1302_readBufferRAM(&probe_dev, buf, sizeof(buf)); DS1302_writeBufferRAM(&probe_dev, buf, sizeof(buf)); }
+static void probe_restore(void) { DS1302_Snapshot snapshot; DS1302_snapshot(&probe_dev, &snapshot); DS1302_restore(&probe_dev, &snapshot, false); }
+static void probe_burstStep(void)
+{
+	DS1302_Burst burst;
+	DS1302_readBufferRAM(&probe_dev, probe_ram, sizeof(probe_ram));
+	DS1302_burstBeginRAM(&probe_dev, &burst, probe_ram, sizeof(probe_ram), false);
+	while (!DS1302_burstStep(&burst, 50)) {
+	}
+}
+static void probe_logAppend(void)
+{
+	DS1302_DateTime dt;
+	DS1302_readBufferRAM(&probe_dev, probe_ram, sizeof(probe_ram));
+	if (DS1302_getDateTime(&probe_dev, &dt)) DS1302_logAppend(&probe_dev, DS1302_LOG_WAKE, DS1302_dateTimeToEpoch(&dt));
+	DS1302_writeBufferRAM(&probe_dev, probe_ram, sizeof(probe_ram));
+}
+static void probe_cacheSetDateTime(void) { DS1302_DateTime dt = { 0, 0, 0, 6, 1, 1, 2000 }; DS1302_cacheBegin(&probe_cache, &probe_dev, 1000); DS1302_cacheSetDateTime(&probe_cache, &dt); }
+static void probe_cacheReadByteRAM(void) { DS1302_cacheBegin(&probe_cache, &probe_dev, 1000); DS1302_cacheReadByteRAM(&probe_cache, NUM_DS1302_RAM_REGS - 1); }
+static void probe_cacheGetDateTime(void)
+{
+	DS1302_DateTime dt;
+	DS1302_cacheBegin(&probe_cache, &probe_dev, 1000);
+	if (DS1302_getDateTime(&probe_dev, &dt)) DS1302_cacheSetDateTime(&probe_cache, &dt);
+	DS1302_cacheGetDateTime(&probe_cache, &dt);
+}
+static void probe_cacheFlush(void)
+{
+	DS1302_DateTime dt;
+	DS1302_cacheBegin(&probe_cache, &probe_dev, 1000);
+	if (DS1302_getDateTime(&probe_dev, &dt)) DS1302_cacheSetDateTime(&probe_cache, &dt);
+	DS1302_cacheWriteByteRAM(&probe_cache, NUM_DS1302_RAM_REGS - 1, DS1302_readByteRAM(&probe_dev, NUM_DS1302_RAM_REGS - 1));
+	DS1302_cacheFlush(&probe_cache);
+}
+
+static const struct {
+	const char *name;
+	void (*call)(void);
+} probes[] = {
+	{ "DS1302_getDateTime", probe_getDateTime },
+	{ "DS1302_getFields", probe_getFields },
+	{ "DS1302_getTime", probe_getTime },
+	{ "DS1302_isHalted", probe_isHalted },
+	{ "DS1302_isWriteProtected", probe_isWriteProtected },
+	{ "DS1302_readClockRegister", probe_readClockRegister },
+	{ "DS1302_readByteRAM", probe_readByteRAM },
+	{ "DS1302_writeByteRAM", probe_writeByteRAM },
+	{ "DS1302_readBufferRAM", probe_readBufferRAM },
+	{ "DS1302_snapshot", probe_snapshot },
+	{ "DS1302_linkProbe", probe_linkProbe },
+	{ "DS1302_linkCheck", probe_linkCheck },
+	{ "DS1302_logRead", probe_logRead },
+	{ "DS1302_tzToLocal", probe_tzToLocal },
+	{ "DS1302_setDateTime", probe_setDateTime },
+	{ "DS1302_setFields", probe_setFields },
+	{ "DS1302_setTime", probe_setTime },
+	{ "DS1302_halt", probe_halt },
+	{ "DS1302_writeBufferRAM", probe_writeBufferRAM },
+	{ "DS1302_restore", probe_restore },
+	{ "DS1302_burstStep", probe_burstStep },
+	{ "DS1302_logAppend", probe_logAppend },
+	{ "DS1302_cacheSetDateTime", probe_cacheSetDateTime },
+	{ "DS1302_cacheReadByteRAM", probe_cacheReadByteRAM },
+	{ "DS1302_cacheGetDateTime", probe_cacheGetDateTime },
+	{ "DS1302_cacheFlush", probe_cacheFlush },
+};
+
+static void probe_task(void *pvParameters)
+{
+	void (*call)(void) = pvParameters;
+
+	call();
+	xTaskNotify(probe_parent, uxTaskGetStackHighWaterMark(NULL), eSetValueWithOverwrite);
+	vTaskDelete(NULL);
+}
+
+void stackProfile(void *pvParameters)
+{
+	// Initialize RTC
+	if (!DS1302_begin(&probe_dev, CONFIG_CLK_GPIO, CONFIG_IO_GPIO, CONFIG_CE_GPIO)) {
+		ESP_LOGE(pcTaskGetName(0), "Error: DS1302 begin link=%d", probe_dev.link);
+		while (1) { vTaskDelay(1); }
+	}
+
+	probe_parent = xTaskGetCurrentTaskHandle();
+	for (int i = 0; i < (int)(sizeof(probes) / sizeof(probes[0])); i++) {
+		uint32_t free;
+		xTaskCreate(probe_task, "probe", PROBE_STACK_SIZE, probes[i].call, 2, NULL);
+		xTaskNotifyWait(0, 0, &free, portMAX_DELAY);
+		ESP_LOGI(pcTaskGetName(0), "%-24s stack %4d bytes", probes[i].name, (int)(PROBE_STACK_SIZE - free));
+	}
+
+	while(1) {
+		vTaskDelay(1000);
+	}
+}
+#endif
 
 void app_main(void)
 {
@@ -241,7 +398,7 @@ void app_main(void)
 	ESP_LOGI(TAG, "CONFIG_CLK_GPIO = %d", CONFIG_CLK_GPIO);
 	ESP_LOGI(TAG, "CONFIG_IO_GPIO = %d", CONFIG_IO_GPIO);
 	ESP_LOGI(TAG, "CONFIG_CE_GPIO = %d", CONFIG_CE_GPIO);
-	ESP_LOGI(TAG, "CONFIG_TIMEZONE= %d", CONFIG_TIMEZONE);
+	ESP_LOGI(TAG, "TimeZone = %s", DS1302_tzRule()->name);
 	ESP_LOGI(TAG, "Boot count: %d", boot_count);
 
 #if CONFIG_SET_CLOCK
@@ -249,18 +406,23 @@ void app_main(void)
 	if (boot_count == 1) {
 		xTaskCreate(setClock, "setClock", 1024*4, NULL, 2, NULL);
 	} else {
-		xTaskCreate(getClock, "getClock", 1024*4, NULL, 2, NULL);
+		xTaskCreate(getClock, "getClock", CONFIG_GET_CLOCK_STACK_SIZE, NULL, 2, NULL);
 	}
 #endif
 
 #if CONFIG_GET_CLOCK
 	// Get clock
-	xTaskCreate(getClock, "getClock", 1024*4, NULL, 2, NULL);
+	xTaskCreate(getClock, "getClock", CONFIG_GET_CLOCK_STACK_SIZE, NULL, 2, NULL);
 #endif
 
 #if CONFIG_DIFF_CLOCK
 	// Diff clock
 	xTaskCreate(diffClock, "diffClock", 1024*4, NULL, 2, NULL);
 #endif
+
+#if CONFIG_STACK_PROFILE
+	// Stack profile
+	xTaskCreate(stackProfile, "stackProfile", 1024*4, NULL, 2, NULL);
+#endif
 }
 
@@ -0,0 +1,114 @@
+#!/bin/sh
+#
+# Check the .su and .ci files of a -fstack-usage -fcallgraph-info=su build.
+# Fails when a function has a dynamic frame or a frame above the limit,
+# or when the deepest call chain of an entry point uses more than the
+# chain limit. Entry points are the public functions and the static ones
+# which are not called directly (task and timer callbacks).
+# Calls out of the driver (FreeRTOS, esp_timer, gpio) count as 0 bytes.
+#
+# check_stack.sh LIMIT CHAIN_LIMIT FILE.su...
+#
+
+limit=$1
+chain=$2
+shift 2
+
+awk -F'\t' -v limit="$limit" '
+{
+    n = split($1, loc, ":")
+    name = loc[n]
+    file = loc[1]
+    sub(".*/", "", file)
+    if ($3 != "static") {
+        printf "FAIL %s: %s frame %s\n", file, name, $3
+        fail = 1
+    } else if ($2 + 0 > limit + 0) {
+        printf "FAIL %s: %s frame %d bytes, limit %d\n", file, name, $2, limit
+        fail = 1
+    }
+    if ($2 + 0 > max) {
+        max = $2 + 0
+        largest = name
+    }
+    count++
+}
+END {
+    printf "stack: %d functions, largest frame %s %d bytes, limit %d\n", count, largest, max, limit
+    exit fail
+}' "$@" || exit 1
+
+for su in "$@"; do
+    echo "${su%.su}.ci"
+done | xargs cat | awk -v limit="$chain" '
+function quoted(key,    s) {
+    if (!match($0, key ": \"[^\"]*\"")) {
+        return ""
+    }
+    s = substr($0, RSTART, RLENGTH)
+    sub("^" key ": \"", "", s)
+    sub("\"$", "", s)
+    return s
+}
+function short(f) {
+    sub(".*:", "", f)
+    return f
+}
+function depth(f,    i, d, best) {
+    if (f in memo) {
+        return memo[f]
+    }
+    if (f in active) {
+        printf "FAIL %s: recursive call\n", short(f)
+        fail = 1
+        return 0
+    }
+    active[f] = 1
+    best = 0
+    for (i = 1; i <= calls[f]; i++) {
+        d = depth(callee[f, i])
+        if (d > best) {
+            best = d
+            via[f] = callee[f, i]
+        }
+    }
+    delete active[f]
+    memo[f] = frame[f] + best
+    return memo[f]
+}
+/^node:/ {
+    f = quoted("title")
+    label = quoted("label")
+    if (match(label, "[0-9]+ bytes")) {
+        frame[f] = substr(label, RSTART, RLENGTH) + 0
+        defined[f] = 1
+    }
+}
+/^edge:/ {
+    f = quoted("sourcename")
+    callee[f, ++calls[f]] = quoted("targetname")
+    called[quoted("targetname")] = 1
+}
+END {
+    for (f in defined) {
+        if ((f ~ /:/) && (f in called)) {
+            continue
+        }
+        total = depth(f)
+        path = short(f)
+        for (g = f; g in via; g = via[g]) {
+            path = path " > " short(via[g])
+        }
+        if (total > limit + 0) {
+            printf "FAIL %s: chain %d bytes, limit %d: %s\n", short(f), total, limit, path
+            fail = 1
+        }
+        if (total > max) {
+            max = total
+            deepest = path
+        }
+        count++
+    }
+    printf "chains: %d entry points, deepest %d bytes, limit %d: %s\n", count, max, limit, deepest
+    exit fail
+}'
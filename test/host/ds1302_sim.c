@@ -0,0 +1,200 @@
+/*
+ * DS1302 simulator for the host tests.
+ */
+
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_rom_sys.h"
+
+#include "ds1302_sim.h"
+
+Sim sim;
+int testFailures;
+
+static struct {
+    int clk;
+    int io;
+    int ce;
+    int out;
+    int phase;      //!< 0: command, 1: write data, 2: read data
+    uint8_t cmd;
+    uint8_t bit;
+    uint8_t value;
+    uint8_t index;
+} bus;
+
+void simReset(void)
+{
+    memset(&sim, 0x00, sizeof(sim));
+    memset(&bus, 0x00, sizeof(bus));
+    sim.writeLimit = -1;
+}
+
+static uint8_t *simRegister(uint8_t index)
+{
+    bool ram = bus.cmd & 0x40;
+    uint8_t addr = (bus.cmd >> 1) & 0x1F;
+
+    if (addr == 0x1F) {
+        // Burst
+        if (ram) {
+            return (index < 31) ? &sim.ram[index] : NULL;
+        }
+        return (index < 8) ? &sim.clock[index] : NULL;
+    }
+    if (index) {
+        return NULL;
+    }
+    if (ram) {
+        return (addr < 31) ? &sim.ram[addr] : NULL;
+    }
+    return (addr < 9) ? &sim.clock[addr] : NULL;
+}
+
+static void simWrite(void)
+{
+    uint8_t *reg = simRegister(bus.index);
+    bool isWp = !(bus.cmd & 0x40) && (reg == &sim.clock[7]);
+
+    if (sim.writeLimit == 0) {
+        return; // Power lost
+    }
+    if (sim.writeLimit > 0) {
+        sim.writeLimit--;
+    }
+    if (reg && (!(sim.clock[7] & 0x80) || isWp)) {
+        *reg = bus.value;
+    }
+}
+
+static void simPresent(void)
+{
+    uint8_t *reg = simRegister(bus.index);
+    uint8_t value;
+    int64_t second;
+
+    if (sim.rtcPeriodUs && (reg == &sim.clock[0]) && (bus.bit == 0)) {
+        second = ((sim.timeUs - sim.rtcOriginUs) / sim.rtcPeriodUs) % 60;
+        *reg = (uint8_t)(((second / 10) << 4) | (second % 10));
+    }
+    value = reg ? *reg : 0;
+
+    if (sim.fault == SIM_FAULT_BIT_ERROR) {
+        value ^= 0x08;
+    }
+    bus.out = (value >> bus.bit) & 0x01;
+    if (++bus.bit == 8) {
+        bus.bit = 0;
+        bus.index++;
+    }
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    return 0;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode)
+{
+    return 0;
+}
+
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull)
+{
+    return 0;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    int rise;
+    int fall;
+
+    switch (pin) {
+    case SIM_CE:
+        if (level && !bus.ce) {
+            memset(&bus, 0x00, sizeof(bus));
+            bus.clk = 0;
+            sim.transactions++;
+        }
+        bus.ce = level;
+        break;
+    case SIM_IO:
+        bus.io = level;
+        break;
+    case SIM_CLK:
+        rise = level && !bus.clk;
+        fall = !level && bus.clk;
+        bus.clk = level;
+        if (!bus.ce) {
+            break;
+        }
+        if (rise) {
+            sim.bits++;
+        }
+        if ((bus.phase == 0) && rise) {
+            bus.cmd |= (bus.io & 0x01) << bus.bit;
+            if (++bus.bit == 8) {
+                bus.bit = 0;
+                bus.phase = (bus.cmd & 0x01) ? 2 : 1;
+            }
+        } else if ((bus.phase == 1) && rise) {
+            bus.value |= (bus.io & 0x01) << bus.bit;
+            if (++bus.bit == 8) {
+                simWrite();
+                bus.bit = 0;
+                bus.value = 0;
+                bus.index++;
+            }
+        } else if ((bus.phase == 2) && fall) {
+            simPresent();
+        }
+        break;
+    }
+
+    return 0;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    switch (sim.fault) {
+    case SIM_FAULT_STUCK_HIGH:
+        return 1;
+    case SIM_FAULT_STUCK_LOW:
+        return 0;
+    default:
+        return bus.out;
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim.timeUs += (int64_t)ticks * portTICK_PERIOD_MS * 1000;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+    sim.timeUs += us;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    // Time passes while it is polled
+    return ++sim.timeUs;
+}
+
+void vTaskDelete(TaskHandle_t task) {}
+TaskHandle_t xTaskGetCurrentTaskHandle(void) { return NULL; }
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) { return 2; }
+BaseType_t xTaskCreate(void (*code)(void *), const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *task) { return pdPASS; }
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer) { return ESP_OK; }
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout) { return ESP_OK; }
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) { return ESP_OK; }
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) { return ESP_OK; }
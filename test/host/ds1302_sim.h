@@ -0,0 +1,55 @@
+/*
+ * DS1302 simulator for the host tests.
+ * Implements the 3-wire protocol on the GPIO stubs, the FreeRTOS and
+ * esp_timer stubs run on a simulated clock.
+ */
+
+#ifndef TEST_DS1302_SIM_H_
+#define TEST_DS1302_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+//! GPIO numbers of the simulated chip
+#define SIM_CLK     1
+#define SIM_IO      2
+#define SIM_CE      3
+
+//! Electrical faults of the IO line
+typedef enum {
+    SIM_FAULT_NONE = 0,
+    SIM_FAULT_STUCK_HIGH,   //!< IO always reads 1
+    SIM_FAULT_STUCK_LOW,    //!< IO always reads 0
+    SIM_FAULT_BIT_ERROR,    //!< Bit 3 of every byte read is inverted
+} SimFault;
+
+typedef struct {
+    uint8_t clock[9];       //!< Clock registers 0x00..0x07 and trickle charger
+    uint8_t ram[31];        //!< RAM
+    SimFault fault;         //!< IO line fault
+    int64_t timeUs;         //!< Simulated time
+    uint32_t transactions;  //!< CE cycles
+    uint32_t bits;          //!< CLK cycles while CE is high
+    int32_t writeLimit;     //!< Bytes to accept before dropping writes (-1 as no limit)
+    int64_t rtcPeriodUs;    //!< Length of an RTC second, the seconds register runs when not 0
+    int64_t rtcOriginUs;    //!< Simulated time of a rollover to second 0
+} Sim;
+
+extern Sim sim;
+
+void simReset(void);
+
+//! Test result helpers
+extern int testFailures;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        testFailures++; \
+    } \
+} while (0)
+
+#define TEST_RESULT() (printf("%s: %s\n", __FILE__, testFailures ? "FAILED" : "passed"), testFailures ? 1 : 0)
+
+#endif // TEST_DS1302_SIM_H_
@@ -0,0 +1,30 @@
+/*
+ * Host stub of the GPIO driver, backed by the DS1302 simulator.
+ */
+
+#ifndef STUB_GPIO_H_
+#define STUB_GPIO_H_
+
+#include <stdint.h>
+
+typedef int gpio_num_t;
+typedef int esp_err_t;
+
+typedef enum {
+    GPIO_MODE_INPUT,
+    GPIO_MODE_OUTPUT,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_ONLY,
+    GPIO_PULLDOWN_ONLY,
+    GPIO_FLOATING,
+} gpio_pull_mode_t;
+
+esp_err_t gpio_reset_pin(gpio_num_t pin);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t mode);
+esp_err_t gpio_set_pull_mode(gpio_num_t pin, gpio_pull_mode_t pull);
+
+#endif // STUB_GPIO_H_
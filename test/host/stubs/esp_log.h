@@ -0,0 +1,15 @@
+/*
+ * Host stub of esp_log.
+ */
+
+#ifndef STUB_ESP_LOG_H_
+#define STUB_ESP_LOG_H_
+
+#include <stdio.h>
+
+#define ESP_LOGE(tag, format, ...)  printf("E %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...)  printf("W %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...)  printf("I %s: " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...)  do { } while (0)
+
+#endif // STUB_ESP_LOG_H_
@@ -0,0 +1,12 @@
+/*
+ * Host stub of esp_rom_sys, the time is simulated.
+ */
+
+#ifndef STUB_ESP_ROM_SYS_H_
+#define STUB_ESP_ROM_SYS_H_
+
+#include <stdint.h>
+
+void esp_rom_delay_us(uint32_t us);
+
+#endif // STUB_ESP_ROM_SYS_H_
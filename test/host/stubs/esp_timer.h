@@ -0,0 +1,28 @@
+/*
+ * Host stub of esp_timer, the time is simulated.
+ */
+
+#ifndef STUB_ESP_TIMER_H_
+#define STUB_ESP_TIMER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ESP_OK 0
+
+typedef int esp_err_t;
+typedef struct esp_timer *esp_timer_handle_t;
+
+typedef struct {
+    void (*callback)(void *arg);
+    void *arg;
+    const char *name;
+} esp_timer_create_args_t;
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *timer);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+esp_err_t esp_timer_delete(esp_timer_handle_t timer);
+int64_t esp_timer_get_time(void);
+
+#endif // STUB_ESP_TIMER_H_
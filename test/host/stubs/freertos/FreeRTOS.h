@@ -0,0 +1,23 @@
+/*
+ * Host stub of FreeRTOS for the driver tests.
+ */
+
+#ifndef STUB_FREERTOS_H_
+#define STUB_FREERTOS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+
+#define pdTRUE              1
+#define pdFALSE             0
+#define pdPASS              1
+#define portMAX_DELAY       0xFFFFFFFF
+#define portTICK_PERIOD_MS  10
+
+#endif // STUB_FREERTOS_H_
@@ -0,0 +1,21 @@
+/*
+ * Host stub of the FreeRTOS task API for the driver tests.
+ */
+
+#ifndef STUB_TASK_H_
+#define STUB_TASK_H_
+
+#include "freertos/FreeRTOS.h"
+
+#define eSetValueWithOverwrite  3
+
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xTaskCreate(void (*code)(void *), const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+
+#endif // STUB_TASK_H_
@@ -0,0 +1,3 @@
+/*
+ * Host stub of sdkconfig.h, options are given with -D by the Makefile.
+ */
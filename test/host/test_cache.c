@@ -0,0 +1,145 @@
+/*
+ * Write-back cache: replay a write trace with and without the cache,
+ * compare the chip contents and report the transactions saved.
+ *
+ * Trace of one minute: a 4 byte counter in RAM every second,
+ * a status byte every 7 seconds and a time set every 10 seconds.
+ */
+
+#include <string.h>
+
+#include "ds1302_sim.h"
+#include "ds1302_cache.h"
+
+#define TRACE_STEP_US   100000
+#define TRACE_STEPS     600
+#define FLUSH_DELAY_MS  5000
+
+static DS1302_Dev dev;
+static DS1302_Cache cache;
+
+//! Longest time the last time set can have been pending [s]
+static uint32_t pendingMax;
+
+//! Time set at a step (seconds since 2000-01-01)
+static uint32_t setEpoch(int step)
+{
+    return 800000000 + step * 3;
+}
+
+/*!
+ * Replay the trace
+ * \return Epoch of the last time set
+ */
+static uint32_t replay(bool cached)
+{
+    DS1302_DateTime dt;
+    int64_t setUs = 0;
+    uint32_t epoch = 0;
+    uint32_t counter = 0;
+
+    for (int step = 0; step < TRACE_STEPS; step++) {
+        if (step % 10 == 0) {
+            counter++;
+            for (uint8_t i = 0; i < 4; i++) {
+                uint8_t value = (uint8_t)(counter >> (8 * i));
+                if (cached) {
+                    DS1302_cacheWriteByteRAM(&cache, i, value);
+                } else {
+                    DS1302_writeByteRAM(&dev, i, value);
+                }
+            }
+        }
+        if (step % 70 == 0) {
+            if (cached) {
+                DS1302_cacheWriteByteRAM(&cache, 20, (uint8_t)step);
+            } else {
+                DS1302_writeByteRAM(&dev, 20, (uint8_t)step);
+            }
+        }
+        if (step % 100 == 50) {
+            epoch = setEpoch(step);
+            setUs = sim.timeUs;
+            DS1302_epochToDateTime(epoch, &dt);
+            if (cached) {
+                DS1302_cacheSetDateTime(&cache, &dt);
+            } else {
+                DS1302_setDateTime(&dev, &dt);
+            }
+        }
+        if (cached) {
+            DS1302_cachePoll(&cache);
+        }
+        sim.timeUs += TRACE_STEP_US;
+    }
+
+    if (cached) {
+        DS1302_cacheFlush(&cache);
+    }
+    pendingMax = (uint32_t)((sim.timeUs - setUs) / 1000000);
+
+    return epoch;
+}
+
+int main(void)
+{
+    uint8_t ram[NUM_DS1302_RAM_REGS];
+    uint8_t clock[8];
+    DS1302_DateTime dt;
+    uint32_t direct;
+    uint32_t epoch;
+    uint32_t set;
+
+    // Without the cache
+    simReset();
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    direct = dev.transfers;
+    replay(false);
+    direct = dev.transfers - direct;
+    memcpy(ram, sim.ram, sizeof(ram));
+    memcpy(clock, sim.clock, sizeof(clock));
+
+    // With the cache
+    simReset();
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    DS1302_cacheBegin(&cache, &dev, FLUSH_DELAY_MS);
+    set = replay(true);
+
+    printf("CE cycles: requested %d, without cache %d, issued %d\n",
+           (int)cache.requested, (int)direct, (int)cache.issued);
+    CHECK(cache.requested == direct);
+    CHECK(cache.issued * 4 < cache.requested);
+
+    // Same chip contents, the clock moved on while the set was pending
+    CHECK(memcmp(sim.ram, ram, sizeof(ram)) == 0);
+    CHECK(DS1302_getDateTime(&dev, &dt));
+    epoch = DS1302_dateTimeToEpoch(&dt);
+    CHECK(set == setEpoch(550));
+    CHECK((epoch >= set) && (epoch <= set + pendingMax));
+    CHECK(sim.clock[DS1302_REG_WP] == clock[DS1302_REG_WP]);
+
+    // Reads see pending writes, the clock read flushes first
+    DS1302_cacheWriteByteRAM(&cache, 5, 0x77);
+    CHECK(DS1302_cacheReadByteRAM(&cache, 5) == 0x77);
+    CHECK(sim.ram[5] != 0x77);
+    DS1302_epochToDateTime(setEpoch(0), &dt);
+    DS1302_cacheSetDateTime(&cache, &dt);
+    CHECK(DS1302_cacheGetDateTime(&cache, &dt));
+    CHECK(DS1302_dateTimeToEpoch(&dt) == setEpoch(0));
+    DS1302_cacheFlush(&cache);
+    CHECK(sim.ram[5] == 0x77);
+
+    // Other fields written in between keep the fractions of the pending time
+    DS1302_epochToDateTime(setEpoch(0), &dt);
+    DS1302_cacheSetDateTime(&cache, &dt);
+    for (int i = 0; i < 10; i++) {
+        sim.timeUs += 900000;
+        DS1302_cacheSetFields(&cache, DS1302_FIELD_DAY_WEEK, &dt);
+    }
+    DS1302_cacheFlush(&cache);
+    CHECK(DS1302_getDateTime(&dev, &dt));
+    epoch = DS1302_dateTimeToEpoch(&dt);
+    CHECK(epoch == setEpoch(0) + 9);
+
+    return TEST_RESULT();
+}
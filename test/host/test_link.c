@@ -0,0 +1,114 @@
+/*
+ * Link check: one fault injection case per DS1302_Link class,
+ * the cost of the check in DS1302_begin() and recovery of dev->link.
+ */
+
+#include <string.h>
+
+#include "ds1302_sim.h"
+#include "ds1302.h"
+
+static const uint8_t clock[8] = { 0x15, 0x30, 0x12, 0x05, 0x06, 0x03, 0x24, 0x80 };
+
+static DS1302_Dev dev;
+
+static void setup(SimFault fault)
+{
+    simReset();
+    memcpy(sim.clock, clock, sizeof(clock));
+    sim.ram[NUM_DS1302_RAM_REGS - 1] = 0x3C;
+    sim.fault = fault;
+}
+
+//! With a working bus the check reads the clock once and never writes the RAM
+static void testOk(uint8_t wp)
+{
+    setup(SIM_FAULT_NONE);
+    sim.clock[DS1302_REG_WP] = wp;
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    CHECK(sim.transactions == 3); // Probe, halt flag write and check
+    CHECK(dev.link == DS1302_LINK_OK);
+    CHECK(sim.ram[NUM_DS1302_RAM_REGS - 1] == 0x3C);
+
+    sim.transactions = 0;
+    sim.writeLimit = 0;
+    CHECK(DS1302_linkProbe(&dev) == DS1302_LINK_OK);
+    CHECK(sim.transactions == 1);
+    sim.writeLimit = -1;
+}
+
+//! A zeroed chip is inconclusive, the canary confirms the bus
+static void testZeroed(void)
+{
+    setup(SIM_FAULT_NONE);
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    memset(sim.clock, 0x00, sizeof(sim.clock));
+    sim.transactions = 0;
+    CHECK(DS1302_linkProbe(&dev) == DS1302_LINK_OK);
+    CHECK(sim.transactions > 1);
+    CHECK(sim.ram[NUM_DS1302_RAM_REGS - 1] == 0x3C);
+}
+
+static void testFault(SimFault fault, DS1302_Link expected)
+{
+    setup(fault);
+    CHECK(!DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    CHECK(dev.link == expected);
+
+    // The explicit canary agrees
+    CHECK(DS1302_linkCheck(&dev) == expected);
+}
+
+//! A fault seen by a clock read is cleared by the next valid read
+static void testLatch(void)
+{
+    DS1302_DateTime dt;
+
+    setup(SIM_FAULT_NONE);
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+
+    sim.fault = SIM_FAULT_STUCK_HIGH;
+    CHECK(!DS1302_getDateTime(&dev, &dt));
+    CHECK(dev.link == DS1302_LINK_STUCK_HIGH);
+
+    sim.fault = SIM_FAULT_NONE;
+    CHECK(DS1302_getDateTime(&dev, &dt));
+    CHECK(dev.link == DS1302_LINK_OK);
+    CHECK(dt.minute == 30);
+}
+
+//! A stuck low line reads a valid 00:00:00, that must not clear the fault
+static void testStuckLowTime(void)
+{
+    uint8_t hour;
+    uint8_t minute;
+    uint8_t second;
+
+    setup(SIM_FAULT_STUCK_LOW);
+    CHECK(!DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    CHECK(dev.link == DS1302_LINK_STUCK_LOW);
+
+    CHECK(DS1302_getTime(&dev, &hour, &minute, &second));
+    CHECK((hour == 0) && (minute == 0) && (second == 0));
+    CHECK(dev.link == DS1302_LINK_STUCK_LOW);
+
+    // A time which is not all zero clears it
+    sim.fault = SIM_FAULT_NONE;
+    CHECK(DS1302_getTime(&dev, &hour, &minute, &second));
+    CHECK(dev.link == DS1302_LINK_OK);
+    CHECK(minute == 30);
+}
+
+int main(void)
+{
+    testOk(0x80);
+    testOk(0x00);
+    testZeroed();
+    testFault(SIM_FAULT_STUCK_HIGH, DS1302_LINK_STUCK_HIGH);
+    testFault(SIM_FAULT_STUCK_LOW, DS1302_LINK_STUCK_LOW);
+    testFault(SIM_FAULT_BIT_ERROR, DS1302_LINK_BIT_ERROR);
+    testLatch();
+    testStuckLowTime();
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,154 @@
+/*
+ * Event log: wraparound, corruption recovery and interrupted appends.
+ */
+
+#include <string.h>
+
+#include "ds1302_sim.h"
+#include "ds1302_log.h"
+
+static DS1302_Dev dev;
+
+//! Reference of all appended events
+static DS1302_LogEvent ref[1000];
+static int numRef;
+
+static void append(uint8_t code, uint32_t epoch)
+{
+    CHECK(DS1302_logAppend(&dev, code, epoch));
+    ref[numRef].code = code;
+    ref[numRef].epoch = epoch;
+    numRef++;
+}
+
+//! The log holds the newest events of the reference
+static void checkNewest(int minEvents)
+{
+    DS1302_LogEvent events[DS1302_LOG_MAX_EVENTS];
+    int count = DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS);
+
+    CHECK(count >= minEvents);
+    CHECK(count <= numRef);
+    for (int i = 0; i < count; i++) {
+        const DS1302_LogEvent *expected = &ref[numRef - count + i];
+        CHECK(events[i].code == expected->code);
+        CHECK(events[i].epoch == expected->epoch);
+    }
+}
+
+static void testWraparound(void)
+{
+    uint32_t epoch = 800000000;
+    uint32_t seed = 1;
+
+    DS1302_logFormat(&dev);
+    numRef = 0;
+    CHECK(DS1302_logRead(&dev, NULL, 0) == 0);
+
+    // Deltas from 0 to several days, records of 1 to 4 bytes
+    for (int i = 0; i < 1000; i++) {
+        seed = seed * 1103515245 + 12345;
+        epoch += (seed >> 8) % ((i % 4 == 0) ? 16 : 400000);
+        append(1 + (seed >> 4) % DS1302_LOG_MAX_CODE, epoch);
+        checkNewest((numRef < 4) ? numRef : 4);
+    }
+
+    // Older epoch is rejected
+    CHECK(!DS1302_logAppend(&dev, DS1302_LOG_RESET, epoch - 1));
+    checkNewest(4);
+}
+
+static void testCorruption(void)
+{
+    DS1302_LogEvent events[DS1302_LOG_MAX_EVENTS];
+
+    DS1302_logFormat(&dev);
+    numRef = 0;
+    for (int i = 0; i < 5; i++) {
+        append(DS1302_LOG_WAKE, 1000 + i * 100);
+    }
+
+    // Free bytes are not covered by the checksum
+    sim.ram[30] ^= 0xFF;
+    CHECK(DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS) == 5);
+
+    // A flipped data byte in use is detected
+    sim.ram[16] ^= 0x04;
+    CHECK(DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS) == -1);
+
+    // The next append erases the log and starts over
+    CHECK(DS1302_logAppend(&dev, DS1302_LOG_POWER_FAIL, 5000));
+    CHECK(DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS) == 1);
+    CHECK(events[0].code == DS1302_LOG_POWER_FAIL);
+    CHECK(events[0].epoch == 5000);
+}
+
+/*!
+ * Power fails after each possible number of written bytes.
+ * The log must hold the newest events: the old ones, the old ones without
+ * the dropped ones, or those and the new one.
+ */
+static void testInterrupted(int filled, uint32_t delta)
+{
+    DS1302_LogEvent events[DS1302_LOG_MAX_EVENTS];
+    uint32_t epoch = 1000 + (filled - 1) * 100 + delta;
+    int before;
+    int count;
+    bool full;
+    bool done = false;
+
+    for (int limit = 0; !done; limit++) {
+        DS1302_logFormat(&dev);
+        numRef = 0;
+        for (int i = 0; i < filled; i++) {
+            append(DS1302_LOG_WAKE, 1000 + i * 100);
+        }
+        before = DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS);
+        full = (before < filled);
+
+        sim.writeLimit = limit;
+        DS1302_logAppend(&dev, DS1302_LOG_RESET, epoch);
+        done = (sim.writeLimit > 0);
+        sim.writeLimit = -1;
+
+        count = DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS);
+        CHECK(count > 0);
+        if (full) {
+            CHECK((count >= before - 2) && (count <= before));
+        } else {
+            CHECK((count == before) || (count == before + 1));
+        }
+        if ((count > 0) && (events[count - 1].code == DS1302_LOG_RESET)) {
+            ref[numRef].code = DS1302_LOG_RESET;
+            ref[numRef].epoch = epoch;
+            numRef++;
+        }
+        checkNewest(count);
+
+        // The next append continues from what was read
+        append(DS1302_LOG_POWER_FAIL, 100000);
+        before = count;
+        count = DS1302_logRead(&dev, events, DS1302_LOG_MAX_EVENTS);
+        if (full) {
+            CHECK((count >= before - 2) && (count <= before + 1));
+        } else {
+            CHECK(count == before + 1);
+        }
+        checkNewest(count);
+    }
+}
+
+int main(void)
+{
+    simReset();
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+
+    testWraparound();
+    testCorruption();
+    testInterrupted(5, 0);      // One byte record
+    testInterrupted(5, 50000);  // Three byte record
+    testInterrupted(12, 0);     // Full log, one record dropped
+    testInterrupted(12, 50000); // Full log, two records dropped
+
+    return TEST_RESULT();
+}
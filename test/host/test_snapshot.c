@@ -0,0 +1,87 @@
+/*
+ * Snapshot and restore round trip, and CE cycles against the per-call approach.
+ */
+
+#include <string.h>
+
+#include "ds1302_sim.h"
+#include "ds1302.h"
+
+static const uint8_t clock[9] = { 0x15, 0x30, 0x12, 0x05, 0x06, 0x03, 0x24, 0x80, 0xA5 };
+
+//! Clock after a sleep, write protect cleared
+static const uint8_t later[8] = { 0x42, 0x47, 0x13, 0x05, 0x06, 0x03, 0x24, 0x00 };
+
+int main(void)
+{
+    DS1302_Dev dev;
+    DS1302_Snapshot snapshot;
+    DS1302_DateTime dt;
+    uint8_t ram[NUM_DS1302_RAM_REGS];
+    uint32_t transfers;
+    uint32_t perCall;
+    uint32_t snap;
+
+    simReset();
+    memcpy(sim.clock, clock, sizeof(clock));
+    for (int i = 0; i < NUM_DS1302_RAM_REGS; i++) {
+        sim.ram[i] = (uint8_t)(i * 7 + 1);
+    }
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+
+    // Per-call approach
+    transfers = dev.transfers;
+    DS1302_getDateTime(&dev, &dt);
+    DS1302_isWriteProtected(&dev);
+    DS1302_isHalted(&dev);
+    DS1302_readClockRegister(&dev, DS1302_REG_TC);
+    DS1302_readBufferRAM(&dev, ram, sizeof(ram));
+    perCall = dev.transfers - transfers;
+
+    transfers = dev.transfers;
+    DS1302_snapshot(&dev, &snapshot);
+    snap = dev.transfers - transfers;
+
+    printf("CE cycles: snapshot %d, per-call %d\n", (int)snap, (int)perCall);
+    CHECK(snap == 3);
+    CHECK(snap < perCall);
+    CHECK(sizeof(snapshot) == 8 + 1 + NUM_DS1302_RAM_REGS);
+    CHECK(memcmp(snapshot.clock, sim.clock, 8) == 0);
+    CHECK(snapshot.trickleCharger == 0xA5);
+    CHECK(memcmp(snapshot.ram, sim.ram, NUM_DS1302_RAM_REGS) == 0);
+
+    // Wipe the chip with write protect set, then restore
+    memset(sim.clock, 0x00, sizeof(sim.clock));
+    memset(sim.ram, 0x00, sizeof(sim.ram));
+    sim.clock[DS1302_REG_WP] = 0x80;
+
+    transfers = dev.transfers;
+    DS1302_restore(&dev, &snapshot, true);
+    CHECK(dev.transfers - transfers == 4);
+    CHECK(memcmp(sim.clock, clock, sizeof(clock)) == 0);
+    for (int i = 0; i < NUM_DS1302_RAM_REGS; i++) {
+        CHECK(sim.ram[i] == (uint8_t)(i * 7 + 1));
+    }
+
+    // After sleep: the clock kept running, only the rest is restored
+    memcpy(sim.clock, later, sizeof(later));
+    sim.clock[DS1302_REG_TC] = 0x00;
+    memset(sim.ram, 0x00, sizeof(sim.ram));
+
+    transfers = dev.transfers;
+    DS1302_restore(&dev, &snapshot, false);
+    CHECK(dev.transfers - transfers == 5);
+    CHECK(memcmp(sim.clock, later, DS1302_REG_WP) == 0);
+    CHECK(sim.clock[DS1302_REG_WP] == 0x80);
+    CHECK(sim.clock[DS1302_REG_TC] == 0xA5);
+    CHECK(memcmp(sim.ram, snapshot.ram, NUM_DS1302_RAM_REGS) == 0);
+
+    // A halt flag different from the snapshot is restored, the time fields are kept
+    sim.clock[DS1302_REG_WP] = 0x00;
+    sim.clock[DS1302_REG_SECONDS] |= 0x80;
+    DS1302_restore(&dev, &snapshot, false);
+    CHECK(sim.clock[DS1302_REG_SECONDS] == later[DS1302_REG_SECONDS]);
+    CHECK(memcmp(sim.clock, later, DS1302_REG_WP) == 0);
+
+    return TEST_RESULT();
+}
@@ -0,0 +1,126 @@
+/*
+ * Tick service against a drifting RTC: the phase and the period are
+ * corrected while the timer keeps running, a full relock only happens
+ * when the RTC is a second or more away from the prediction.
+ *
+ * The service source is included to drive its timer callback and its
+ * verification step without tasks. The verification of a boundary
+ * starts before it and the timer callback of that boundary runs in
+ * between, as on the target.
+ */
+
+#include <stdlib.h>
+
+#include "ds1302_sim.h"
+#include "../../main/ds1302_tick.c"
+
+static DS1302_Dev dev;
+
+//! RTC second starting at the rollover nearest to a time
+static int64_t nearest(int64_t time)
+{
+    int64_t t = time - sim.rtcOriginUs;
+
+    return (t + sim.rtcPeriodUs / 2) / sim.rtcPeriodUs;
+}
+
+/*!
+ * Run the service for a number of ticks
+ * \return Largest phase error of the last settled ticks [us]
+ */
+static int64_t run(int ticks, int settle, int *relocks)
+{
+    int64_t worst = 0;
+    int64_t boundary;
+    int64_t error;
+    int64_t start;
+    uint32_t armed = tick.verifyTick;
+    bool pending = false;
+    int64_t pendingUs = 0;
+    uint32_t pendingTick = 0;
+    uint8_t pendingSecond = 0;
+
+    for (int i = 0; i < ticks; i++) {
+        boundary = tick.nextUs;
+        if (sim.timeUs < boundary) {
+            sim.timeUs = boundary;
+        }
+
+        // The second labelled by the tick must be the one starting at the nearest rollover
+        error = boundary - (sim.rtcOriginUs + nearest(boundary) * sim.rtcPeriodUs);
+        DS1302_tickHandler(NULL);
+        if (i >= settle) {
+            CHECK(tick.second == nearest(boundary) % 60);
+            worst = (llabs(error) > worst) ? llabs(error) : worst;
+        }
+
+        // Verification woken before the boundary, the timer callback ran during it
+        if (pending) {
+            int64_t nextUs = tick.verifyUs;
+            uint32_t nextTick = tick.verifyTick;
+            uint8_t nextSecond = tick.verifySecond;
+
+            tick.verifyUs = pendingUs;
+            tick.verifyTick = pendingTick;
+            tick.verifySecond = pendingSecond;
+            start = pendingUs - DS1302_TICK_MARGIN - DS1302_TICK_WAKE_LEAD;
+            sim.timeUs = start;
+            DS1302_tickCheck();
+            if (sim.timeUs - start > 2 * DS1302_TICK_MARGIN + 2 * DS1302_TICK_WAKE_LEAD) {
+                (*relocks)++;
+                armed = tick.verifyTick;
+            }
+            tick.verifyUs = nextUs;
+            tick.verifyTick = nextTick;
+            tick.verifySecond = nextSecond;
+            pending = false;
+        }
+        if (tick.verifyTick != armed) {
+            armed = tick.verifyTick;
+            pending = true;
+            pendingUs = tick.verifyUs;
+            pendingTick = tick.verifyTick;
+            pendingSecond = tick.verifySecond;
+        }
+    }
+
+    return worst;
+}
+
+int main(void)
+{
+    int relocks = 0;
+    int64_t worst;
+
+    simReset();
+    sim.rtcPeriodUs = 1000040; // RTC crystal 40 ppm slow
+    sim.rtcOriginUs = 123456;
+    CHECK(DS1302_begin(&dev, SIM_CLK, SIM_IO, SIM_CE));
+    CHECK(DS1302_tickBegin(&dev, 10));
+
+    // Drift is tracked without relocking
+    worst = run(3600, 600, &relocks);
+    printf("40 ppm: phase error %d us, period %d us, relocks %d\n",
+           (int)worst, (int)(tick.periodQ8 >> 8), relocks);
+    CHECK(relocks == 0);
+    CHECK(worst < DS1302_TICK_MARGIN);
+    CHECK(llabs((tick.periodQ8 >> 8) - sim.rtcPeriodUs) <= 5);
+
+    // A 300 ms phase jump is stepped out without relocking
+    sim.rtcOriginUs += 300000;
+    worst = run(600, 60, &relocks);
+    printf("300 ms jump: phase error %d us, relocks %d\n", (int)worst, relocks);
+    CHECK(relocks == 0);
+    CHECK(worst < DS1302_TICK_MARGIN);
+
+    // A jump of whole seconds needs a relock
+    sim.rtcOriginUs += 2000000;
+    worst = run(600, 60, &relocks);
+    printf("2 s jump: phase error %d us, relocks %d\n", (int)worst, relocks);
+    CHECK(relocks == 1);
+    CHECK(worst < DS1302_TICK_MARGIN);
+
+    DS1302_tickEnd();
+
+    return TEST_RESULT();
+}
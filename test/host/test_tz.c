@@ -0,0 +1,111 @@
+/*
+ * Timezone rules against the C library over 2000..2099, and conversion speed.
+ * Built once per zone with CONFIG_TZ_xxx and TEST_TZ, the POSIX TZ string of the zone.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ds1302_sim.h"
+#include "ds1302_tz.h"
+
+//! 2000-01-01 00:00:00 as Unix time
+#define EPOCH_2000  946684800
+
+//! Last second of 2099 in DS1302 epoch
+#define EPOCH_END   3155759999u
+
+static int64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void checkTime(uint32_t utc)
+{
+    time_t t = (time_t)utc + EPOCH_2000;
+    struct tm tm;
+    int64_t expected;
+    uint32_t local;
+    uint32_t back;
+
+    localtime_r(&t, &tm);
+    expected = (int64_t)utc + tm.tm_gmtoff;
+    local = DS1302_tzUtcToLocal(utc);
+
+    CHECK(DS1302_tzIsDst(utc) == (tm.tm_isdst > 0));
+    CHECK(local == ((expected < 0) ? 0 : expected));
+    if (expected < 0) {
+        return;
+    }
+
+    // Every local time produced maps back. A repeated time is taken as DST.
+    back = DS1302_tzLocalToUtc(local);
+    CHECK(DS1302_tzUtcToLocal(back) == local);
+    if (tm.tm_isdst > 0) {
+        CHECK(back == utc);
+    }
+}
+
+static void sweep(void)
+{
+    // Transitions are on the hour or half hour
+    for (uint32_t utc = 0; utc <= EPOCH_END - 1800; utc += 1800) {
+        checkTime(utc);
+        checkTime(utc + 1799);
+    }
+    checkTime(EPOCH_END);
+}
+
+static void benchmark(void)
+{
+    const int count = 1000000;
+    volatile uint32_t sink = 0;
+    uint32_t utc = 700000000;
+    int64_t start;
+    int64_t rule;
+    int64_t libc;
+    struct tm tm;
+    time_t t;
+
+    start = nowNs();
+    for (int i = 0; i < count; i++) {
+        sink += DS1302_tzUtcToLocal(utc + i * 61);
+    }
+    rule = nowNs() - start;
+
+    start = nowNs();
+    for (int i = 0; i < count; i++) {
+        t = (time_t)(utc + i * 61) + EPOCH_2000;
+        localtime_r(&t, &tm);
+        sink += tm.tm_sec;
+    }
+    libc = nowNs() - start;
+
+    printf("%s: DS1302_tzUtcToLocal %d ns, localtime_r %d ns per conversion\n",
+           DS1302_tzRule()->name, (int)(rule / count), (int)(libc / count));
+}
+
+int main(void)
+{
+    const DS1302_TzRule *rule = DS1302_tzRule();
+    int32_t east = (rule->dstOffset > rule->stdOffset) ? rule->dstOffset : rule->stdOffset;
+    int32_t west = (rule->dstOffset < rule->stdOffset) ? rule->dstOffset : rule->stdOffset;
+
+    setenv("TZ", TEST_TZ, 1);
+    tzset();
+
+    // No wrap around at the ends of the range
+    CHECK(DS1302_tzUtcToLocal(0) <= (uint32_t)((east > 0) ? east * 60 : 0));
+    CHECK(DS1302_tzLocalToUtc(0) <= (uint32_t)((west < 0) ? -west * 60 : 0));
+    CHECK(DS1302_tzUtcToLocal(100) < 86400);
+    CHECK(DS1302_tzLocalToUtc(100) < 86400);
+
+    sweep();
+    benchmark();
+
+    return TEST_RESULT();
+}